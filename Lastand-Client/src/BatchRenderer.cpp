@@ -0,0 +1,30 @@
+#include "BatchRenderer.h"
+#include <iostream>
+
+void BatchRenderer::reserve(size_t rects) {
+    vertices.reserve(rects * 4);
+    indices.reserve(rects * 6);
+}
+
+void BatchRenderer::add_rect(const SDL_FRect &rect, SDL_Color color) {
+    SDL_FColor fcolor {color.r / 255.0f, color.g / 255.0f, color.b / 255.0f, color.a / 255.0f};
+    int first {static_cast<int>(vertices.size())};
+    vertices.push_back({{rect.x, rect.y}, fcolor, {0, 0}});
+    vertices.push_back({{rect.x + rect.w, rect.y}, fcolor, {0, 0}});
+    vertices.push_back({{rect.x + rect.w, rect.y + rect.h}, fcolor, {0, 0}});
+    vertices.push_back({{rect.x, rect.y + rect.h}, fcolor, {0, 0}});
+    // two triangles, top left - top right - bottom right and bottom right - bottom left - top left
+    for (int i : {0, 1, 2, 2, 3, 0})
+        indices.push_back(first + i);
+}
+
+void BatchRenderer::flush(SDL_Renderer *renderer) {
+    last_rects = vertices.size() / 4;
+    if (!vertices.empty()) {
+        bool success = SDL_RenderGeometry(renderer, nullptr, vertices.data(), static_cast<int>(vertices.size()),
+                                          indices.data(), static_cast<int>(indices.size()));
+        if (!success) std::cerr << "Error in SDL_RenderGeometry: " << SDL_GetError();
+    }
+    vertices.clear();
+    indices.clear();
+}
@@ -0,0 +1,30 @@
+#pragma once
+#ifndef BATCH_RENDERER_H
+#define BATCH_RENDERER_H
+
+#include <cstddef>
+#include <vector>
+#include <SDL3/SDL.h>
+
+// Collects the filled rectangles drawn during a frame into one vertex array with per-vertex colors
+// and submits them all with a single SDL_RenderGeometry() call, instead of a SDL_SetRenderDrawColor()
+// and SDL_RenderFillRect() per rectangle. Rectangles are drawn in the order they were added, with the
+// renderer's draw blend mode.
+class BatchRenderer {
+public:
+    // makes room for this many rectangles, the arrays are kept between frames so this only matters once
+    void reserve(size_t rects);
+    void add_rect(const SDL_FRect &rect, SDL_Color color);
+    // draws everything added since the last flush
+    void flush(SDL_Renderer *renderer);
+
+    // number of rectangles drawn by the last flush
+    size_t rects_flushed() const { return last_rects; }
+
+private:
+    std::vector<SDL_Vertex> vertices;
+    std::vector<int> indices;
+    size_t last_rects {0};
+};
+
+#endif // BATCH_RENDERER_H
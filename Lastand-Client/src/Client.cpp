@@ -1,8 +1,19 @@
 #include <SDL3/SDL.h>
+#include "BatchRenderer.h"
+#include "CompiledMap.h"
+#include "Compression.h"
+#include "FramePacer.h"
+#include "NetworkEmulator.h"
+#include "NetworkThread.h"
 #include "Obstacle.h"
+#include "PacketPool.h"
+#include "ParticleSystem.h"
+#include "PerfHud.h"
 #include "Player.h"
+#include <algorithm>
 #include <array>
 #include <cassert>
+#include <cfloat>
 #include <cstdint>
 #include <cstdlib>
 #include <iostream>
@@ -14,12 +25,16 @@
 #include "SDL3/SDL_video.h"
 #include "constants.h"
 #include <enet/enet.h>
+#include <filesystem>
 #include <sstream>
 #include <tuple>
 #include <utility>
 #include <vector>
 #include "serialize.h"
+#include "SnapshotInterpolator.h"
+#include "Trace.h"
 #include <map>
+#include <memory>
 #include "imgui.h"
 #include "imgui_impl_sdl3.h"
 #include "imgui_impl_sdlrenderer3.h"
@@ -27,110 +42,76 @@
 
 const uint16_t window_height {window_size + 100};
 
-struct Particle {
-    float x, y;
-    float dx, dy;
-    float life_left;
-    SDL_Color color;
+// kill and victory bursts past this many particles are cut short
+const size_t max_particles {4096};
+// frames are capped at the tick rate unless chosen otherwise
+const uint32_t default_fps_cap {static_cast<uint32_t>(1000 / tick_rate_ms + 0.5)};
 
-    void update() {
-        x += dx;
-        y += dy;
-        life_left -= 0.2;
-    }
-};
-
-template <size_t N>
-std::array<Particle, N> create_particles(int start_x, int start_y, float life = -1) {
-    std::array<Particle, N> particles;
-    for (auto &p : particles) {
-        p.x = start_x;
-        p.y = start_y;
-        p.dx = SDL_rand(6) - 3;
-        p.dy = SDL_rand(6) - 3;
-        p.life_left = life == -1 ? SDL_rand(15) + 5 : life;
-        p.color = {static_cast<Uint8>(SDL_rand(155) + 100), static_cast<Uint8>(SDL_rand(155) + 30), 0, 255};
-    }
-    return particles;
+// position is where to draw the player in game coordinates, which is between snapshots most of the time
+void draw_player(BatchRenderer &batch, const Player &p, SDL_FPoint position) {
+    SDL_FRect frect {position.x / 2, position.y / 2, player_size, player_size};
+    SDL_FRect shadow_frect {frect.x + 3, frect.y + 3, frect.w, frect.h};
+    batch.add_rect(shadow_frect, {p.color.r, p.color.g, p.color.b, 100});
+    batch.add_rect(frect, {p.color.r, p.color.g, p.color.b, p.color.a});
 }
 
-void update_particles(std::vector<Particle> &particles) {
-    for (auto p = particles.begin(); p != particles.end(); ++p) {
-        p->update();
-        if (p->life_left <= 0) {
-            particles.erase(p);
-            p--;
-        }
-    }
+// the name tag above a player, built once and kept until the player changes their username or leaves
+struct UsernameLabel {
+    std::string text;
+};
+using UsernameLabels = std::map<int, UsernameLabel>;
+
+// where the name tag is drawn relative to the player's top left corner
+const ImVec2 username_label_offset {-2, -12};
+// longer usernames are cut to their first few characters
+const float username_label_max_width {30};
+
+const UsernameLabel &get_username_label(UsernameLabels &labels, const Player &p, ImFont *font) {
+    auto label = labels.find(p.id);
+    if (label != labels.end())
+        return label->second;
+    std::string text {p.username};
+    if (font->CalcTextSizeA(font->FontSize, FLT_MAX, 0.0f, text.c_str()).x > username_label_max_width)
+        text = text.substr(0, 5) + "...";
+    return labels.emplace(p.id, UsernameLabel {text}).first->second;
 }
 
-void draw_particles(SDL_Renderer *renderer, const std::vector<Particle> &particles) {
-    for (const auto &p : particles) {
-        SDL_FRect frect {p.x, p.y, 3.0, 3.0};
-        SDL_SetRenderDrawColor(renderer, p.color.r, p.color.g, p.color.b, p.color.a);
-        SDL_RenderFillRect(renderer, &frect);
+// draws every name tag into the background draw list, under the ImGui windows
+void draw_player_usernames(UsernameLabels &labels, const std::map<int, Player> &players, const SnapshotInterpolator &interpolator,
+                           uint64_t now_ns, ImFont *font) {
+    ImDrawList *draw_list {ImGui::GetBackgroundDrawList()};
+    for (const auto &[id, p] : players) {
+        const UsernameLabel &label {get_username_label(labels, p, font)};
+        SDL_FPoint position {interpolator.position(p, now_ns)};
+        ImVec2 pos {position.x / 2 + username_label_offset.x, position.y / 2 + username_label_offset.y};
+        draw_list->AddText(font, font->FontSize, pos, IM_COL32(255, 255, 255, 255), label.text.c_str());
     }
 }
 
-
-void draw_player(SDL_Renderer *renderer, const Player &p) {
-    SDL_FRect frect {static_cast<float>(p.x / 2.0), static_cast<float>(p.y / 2.0), player_size, player_size};
-    SDL_FRect shadow_frect {frect.x + 3, frect.y + 3, frect.w, frect.h};
-    bool success;
-
-    success = SDL_SetRenderDrawColor(renderer, p.color.r, p.color.g, p.color.b, 100);
-    if (!success) std::cerr << "Error in SDL_SetRenderDrawColor: " << SDL_GetError();
-    success = SDL_RenderFillRect(renderer, &shadow_frect);
-    if (!success) std::cerr << "Error in SDL_RenderFillRect: " << SDL_GetError();
-
-    success = SDL_SetRenderDrawColor(renderer, p.color.r, p.color.g, p.color.b, p.color.a);
-    if (!success) std::cerr << "Error in SDL_SetRenderDrawColor: " << SDL_GetError();
-    success = SDL_RenderFillRect(renderer, &frect);
-    if (!success) std::cerr << "Error in SDL_RenderFillRect: " << SDL_GetError();
-}
-
-void draw_player_username(const Player &p, ImFont *font) {
-    ImGui::SetNextWindowPos(ImVec2(p.x / 2.0 - 10, p.y / 2.0 - 20));
-    ImGui::Begin((p.username + "Username").c_str(), nullptr, ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoBackground | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoScrollbar | ImGuiWindowFlags_NoInputs | ImGuiWindowFlags_NoSavedSettings);
-    std::string username_to_display = p.username;
-    if (ImGui::CalcTextSize(username_to_display.c_str()).x > 30)
-        username_to_display = username_to_display.substr(0, 5) + "...";
-    ImGui::PushFont(font);
-    ImGui::Text("%s", username_to_display.c_str());
-    ImGui::PopFont();
-    ImGui::End();
-}
-
-void draw_obstacle(SDL_Renderer *renderer, const Obstacle &o) {
+void draw_obstacle(BatchRenderer &batch, const Obstacle &o) {
     SDL_FRect frect {
         static_cast<float>(o.x / 2.0),
         static_cast<float>(o.y / 2.0),
         static_cast<float>(o.width),
         static_cast<float>(o.height)
     };
-    bool success = SDL_SetRenderDrawColor(renderer, o.color.r, o.color.g, o.color.b, o.color.a);
-    if (!success) std::cerr << "Error in SDL_SetRenderDrawColor: " << SDL_GetError();
-    success = SDL_RenderFillRect(renderer, &frect);
-    if (!success) std::cerr << "Error in SDL_RenderFillRect: " << SDL_GetError();
+    batch.add_rect(frect, {o.color.r, o.color.g, o.color.b, o.color.a});
 }
 
-void draw_projectile(SDL_Renderer *renderer, const Projectile &p) {
+void draw_projectile(BatchRenderer &batch, const Projectile &p) {
     SDL_FRect frect {
         static_cast<float>(p.x / 2.0),
         static_cast<float>(p.y / 2.0),
         3.0, 3.0
     };
-    bool success = SDL_SetRenderDrawColor(renderer, 255, 0, 0, 255);
-    if (!success) std::cerr << "Error in SDL_SetRenderDrawColor: " << SDL_GetError();
-    success = SDL_RenderFillRect(renderer, &frect);
-    if (!success) std::cerr << "Error in SDL_RenderFillRect: " << SDL_GetError();
+    batch.add_rect(frect, {255, 0, 0, 255});
 }
 
 const std::string window_title {"Lastand Client"};
 
-void draw_frame(SDL_Renderer *renderer, const std::vector<Player> &players) {
+void draw_frame(BatchRenderer &batch, const std::vector<Player> &players) {
     for (const auto &player: players)
-        draw_player(renderer, player);
+        draw_player(batch, player, {static_cast<float>(player.x), static_cast<float>(player.y)});
 }
 
 ClientMovement create_client_movement(SDL_Scancode key) {
@@ -216,7 +197,54 @@ std::vector<uint8_t> process_event(const SDL_Event &event, std::pair<short, shor
     }
 }
 
-std::string parse_message_from_server(const std::vector<uint8_t> &data, std::map<int, Player> &player_data, std::vector<Projectile> &projectiles, std::vector<Particle> &particles) {
+// progress of the world being streamed in after joining
+struct WorldLoadState {
+    int player_chunks_received {0};
+    bool players_complete {false};
+
+    MapInfo map {};
+    int obstacle_chunks_received {0};
+    bool map_complete {false};
+    // set when the map isn't cached, the obstacles have to be requested from the server
+    bool request_map {false};
+
+    bool complete() const { return players_complete && map_complete; }
+};
+
+const std::string map_cache_dir {"map_cache"};
+
+std::string cached_map_path(uint64_t hash) {
+    std::stringstream ss;
+    ss << map_cache_dir << '/' << std::hex << hash << ".lmap";
+    return ss.str();
+}
+
+// loads the obstacles of a map that was downloaded before, returns false if it isn't cached
+bool load_cached_map(uint64_t hash, std::vector<Obstacle> &obstacles) {
+    std::string path {cached_map_path(hash)};
+    if (!std::filesystem::exists(path))
+        return false;
+    CompiledMap map;
+    if (!map.open(path))
+        return false;
+    std::vector<Obstacle> cached {map.obstacles()};
+    if (hash_obstacles(cached) != hash) {
+        std::cerr << "Cached map " << path << " does not match its hash" << std::endl;
+        return false;
+    }
+    obstacles = cached;
+    return true;
+}
+
+void save_cached_map(uint64_t hash, const std::vector<Obstacle> &obstacles) {
+    std::error_code ec;
+    std::filesystem::create_directories(map_cache_dir, ec);
+    if (ec || !write_compiled_map(cached_map_path(hash), obstacles))
+        std::cerr << "Could not cache map " << std::hex << hash << std::dec << std::endl;
+}
+
+std::string parse_message_from_server(const std::vector<uint8_t> &data, std::map<int, Player> &player_data, std::vector<Projectile> &projectiles, ParticleSystem &particles,
+                                      std::vector<Obstacle> &obstacles, WorldLoadState &world, UsernameLabels &username_labels) {
     MessageToClientTypes type {data[0]};
     std::vector<uint8_t> data_without_type {data.begin() + 1, data.end()};
     switch (type) {
@@ -231,20 +259,29 @@ std::string parse_message_from_server(const std::vector<uint8_t> &data, std::map
             std::cout << "Player joined" << std::endl;
             Player p {deserialize_player(data_without_type)};
             player_data[p.id] = p;
+            username_labels.erase(p.id);
             return std::string("Player ") + p.username + " joined";
             break;
         }
         case MessageToClientTypes::PlayerLeft: {
-            int id {data_without_type[0]};
+            size_t idx {0};
+            PlayerId id;
+            if (!deserialize_player_id(data_without_type, idx, id) || player_data.find(id) == player_data.end())
+                break;
             std::cout << "Player " << id << " left" << std::endl;
             std::string username = player_data.at(id).username;
             player_data.erase(id);
+            username_labels.erase(id);
             return std::string("Player ") + username + " left";
             break;
         }
         case MessageToClientTypes::UpdateProjectiles: {
             projectiles.clear();
-            for (size_t i = 1, proj = 0; i < data_without_type.size() && proj < data_without_type[0]; i += sizeof(Projectile), proj++) {
+            size_t first_projectile {0};
+            uint32_t num_projectiles;
+            if (!deserialize_varint(data_without_type, first_projectile, num_projectiles))
+                break;
+            for (size_t i = first_projectile, proj = 0; i + sizeof(Projectile) <= data_without_type.size() && proj < num_projectiles; i += sizeof(Projectile), proj++) {
                 std::array<uint8_t, 12> data {
                     data_without_type[i],
                     data_without_type[i + 1],
@@ -264,9 +301,13 @@ std::string parse_message_from_server(const std::vector<uint8_t> &data, std::map
             break;
         }
         case MessageToClientTypes::PlayerKilled: {
-            assert(data_without_type.size() == 2);
-            uint8_t killer {data_without_type[0]};
-            uint8_t killed {data_without_type[1]};
+            size_t idx {0};
+            PlayerId killer, killed;
+            if (!deserialize_player_id(data_without_type, idx, killer) || !deserialize_player_id(data_without_type, idx, killed) ||
+                player_data.find(killer) == player_data.end() || player_data.find(killed) == player_data.end()) {
+                std::cerr << "Invalid player killed message: " << data_without_type << std::endl;
+                break;
+            }
             std::stringstream ss;
             ss << player_data.at(killer).username << " has killed " << player_data.at(killed).username;
             std::cout << ss.str() << std::endl;
@@ -274,10 +315,10 @@ std::string parse_message_from_server(const std::vector<uint8_t> &data, std::map
             // add particles
             int start_x = player_data.at(killed).x / 2 + player_size;
             int start_y = player_data.at(killed).y / 2 + player_size;
-            auto new_particles = create_particles<15>(start_x, start_y);
-            particles.insert(particles.end(), new_particles.begin(), new_particles.end());
+            particles.emit(start_x, start_y, 15);
 
             player_data.erase(killed);
+            username_labels.erase(killed);
             return ss.str();
             break;
         }
@@ -288,19 +329,25 @@ std::string parse_message_from_server(const std::vector<uint8_t> &data, std::map
         }
         case MessageToClientTypes::SetPlayerAttributes: {
             SetPlayerAttributesTypes attribute_type = static_cast<SetPlayerAttributesTypes>(data_without_type[0]);
-            auto player_id = data_without_type[1];
+            size_t idx {1};
+            PlayerId player_id;
+            if (!deserialize_player_id(data_without_type, idx, player_id) || player_data.find(player_id) == player_data.end())
+                break;
             std::stringstream ss;
             std::cout << "Player set attribute: " << (int)player_id << " " << (int)attribute_type << std::endl;
             switch (attribute_type) {
                 case SetPlayerAttributesTypes::UsernameChanged: {
-                    std::string username {data_without_type.begin() + 3, data_without_type.end()};
+                    std::string username {data_without_type.begin() + std::min(idx + 1, data_without_type.size()), data_without_type.end()};
                     std::cout << "Set username of " << (int)player_id << " to: " << username;
                     ss << player_data.at(player_id).username << " has changed their username to " << username << std::endl;
                     player_data.at(player_id).username = username;
+                    username_labels.erase(player_id);
                     break;
                 }
                 case SetPlayerAttributesTypes::ColorChanged: {
-                    Color c {data_without_type[2], data_without_type[3], data_without_type[4], data_without_type[5]};
+                    if (idx + 4 > data_without_type.size())
+                        break;
+                    Color c {data_without_type[idx], data_without_type[idx + 1], data_without_type[idx + 2], data_without_type[idx + 3]};
                     ss << player_data.at(player_id).username << " has changed their color";
                     player_data.at(player_id).color = c;
                     std::cout << "Set color of " << (int)player_id << " to: (" << (int)c.r << ", " << (int)c.g << ", " << (int)c.b << ", " << (int)c.a << ")\n";
@@ -313,32 +360,69 @@ std::string parse_message_from_server(const std::vector<uint8_t> &data, std::map
             break;
         }
         case MessageToClientTypes::PlayerWon: {
-            assert(data_without_type.size() == 1);
-            std::cout << "Player " << (int)data_without_type[0] << " has won!" << std::endl;
-            std::string text = "Player " + std::to_string(data_without_type[0]) + " has won!";
+            size_t idx {0};
+            PlayerId id;
+            if (!deserialize_player_id(data_without_type, idx, id))
+                break;
+            std::cout << "Player " << id << " has won!" << std::endl;
+            std::string text = "Player " + std::to_string(id) + " has won!";
             return text;
             break;
         }
+        case MessageToClientTypes::MapInfo: {
+            world.map = deserialize_map_info(data_without_type);
+            if (world.map.num_chunks == 0) {
+                obstacles.clear();
+                world.map_complete = true;
+            } else if (load_cached_map(world.map.hash, obstacles)) {
+                std::cout << "Using cached map " << std::hex << world.map.hash << std::dec << std::endl;
+                world.map_complete = true;
+            } else {
+                std::cout << "Map " << std::hex << world.map.hash << std::dec << " is not cached, downloading it" << std::endl;
+                obstacles.clear();
+                world.request_map = true;
+            }
+            break;
+        }
+        case MessageToClientTypes::WorldChunk: {
+            ObjectType chunk_type;
+            int chunk_idx = deserialize_world_chunk(data_without_type, player_data, obstacles, chunk_type);
+            int &chunks_received = chunk_type == ObjectType::Player ? world.player_chunks_received : world.obstacle_chunks_received;
+            if (chunk_idx != chunks_received)
+                std::cerr << "Received world chunk " << chunk_idx << ", expected " << chunks_received << std::endl;
+            chunks_received++;
+
+            if (chunk_type == ObjectType::Obstacle && world.obstacle_chunks_received == world.map.num_chunks) {
+                std::cout << "Received " << obstacles.size() << " obstacle(s)" << std::endl;
+                if (hash_obstacles(obstacles) == world.map.hash)
+                    save_cached_map(world.map.hash, obstacles);
+                else
+                    std::cerr << "Downloaded map does not match its hash" << std::endl;
+                world.map_complete = true;
+            }
+            break;
+        }
+        case MessageToClientTypes::WorldComplete: {
+            WorldComplete complete {deserialize_world_complete(data_without_type)};
+            std::cout << "Received " << world.player_chunks_received << " player chunk(s)" << std::endl;
+            if (complete.num_chunks != world.player_chunks_received)
+                std::cerr << "World is incomplete, expected " << complete.num_chunks << " player chunk(s)" << std::endl;
+            world.players_complete = true;
+            break;
+        }
         case MessageToClientTypes::PreviousGameData:
-            break; // previous game data is handled in connect_to_server() function
+            break; // replaced by WorldChunk
+        case MessageToClientTypes::Bundle:
+            break; // split up before getting here
     }
     return "";
 }
 
-template <typename T>
-void send_packet(ENetPeer *peer, const T &data, int channel_id) {
-    ENetPacket *packet = enet_packet_create(data.data(), data.size(), ENET_PACKET_FLAG_RELIABLE);
-    int val = enet_peer_send(peer, channel_id, packet);
-    if (val != 0) {
-        std::cerr << "Failed to send packet: " << val << std::endl;
-        enet_packet_destroy(packet);
-    }
-}
-
-// gets the player that is this client
-Player get_this_player(ENetHost *client) {
+// gets the player that is this client. If the server sends us to another of its matches instead,
+// redirect_port is set to the port to connect to
+Player get_this_player(ENetHost *client, uint16_t &redirect_port) {
     ENetEvent event;
-    int err = enet_host_service(client, &event, 800);
+    int err = service_emulated_host(client, &event, 800);
     if (err < 0) {
         std::cerr << "Failed to get player data: " << err << std::endl;
         std::exit(1);
@@ -352,6 +436,12 @@ Player get_this_player(ENetHost *client) {
                   << this_player.x << ", " << this_player.y << "), (" << (int)this_player.color.r << ','
                   << (int)this_player.color.g << ',' << (int)this_player.color.b << ',' << (int)this_player.color.a << "):"
                   << (int)this_player.id << std::endl;
+    } else if (event.type == ENET_EVENT_TYPE_DISCONNECT && (event.data & disconnect_redirect)) {
+        redirect_port = static_cast<uint16_t>(event.data);
+        std::cout << "The server sent us to the match on port " << redirect_port << std::endl;
+    } else if (event.type == ENET_EVENT_TYPE_DISCONNECT && event.data == disconnect_unsupported_compression) {
+        std::cerr << "The server uses a compression codec this client doesn't support" << std::endl;
+        std::exit(1);
     } else {
         std::cerr << "Did not receive player data: " << event.type << std::endl;
         std::exit(1);
@@ -359,54 +449,44 @@ Player get_this_player(ENetHost *client) {
     return this_player;
 }
 
-std::pair<std::map<int, Player>, std::vector<Obstacle>> get_previous_game_data(ENetHost *client) {
-    ENetEvent event;
-    int err = enet_host_service(client, &event, 800);
-    if (err < 0) {
-        std::cerr << "Failed to get player data: " << err << std::endl;
-        std::exit(1);
-    }
-    if (event.type == ENET_EVENT_TYPE_RECEIVE) {
-        std::vector<uint8_t> vec(event.packet->data + 1, event.packet->data + event.packet->dataLength);
-        std::cout << "Data received: " << *(int*)event.packet->data << " and " << vec << std::endl;
-        auto [previous_players, obstacles] = deserialize_and_update_previous_game_data(vec);
-        std::cout << "Received " << previous_players.size() << " player(s) and " << obstacles.size() << " obstacle(s)" << std::endl;
-        return std::make_pair(previous_players, obstacles);
-    } else {
-        std::cerr << "Did not receive previous game data: " << event.type << std::endl;
-        std::exit(1);
-    }
-}
+// how many times in a row a server can send us to another match before we give up
+constexpr int max_redirects {4};
 
-std::tuple<Player, std::map<int, Player>, std::vector<Obstacle>, ENetPeer*> connect_to_server(ENetHost *client, const std::string &server_addr, int port) {
+std::pair<Player, ENetPeer*> connect_to_server(ENetHost *client, const std::string &server_addr, int port) {
     ENetAddress address;
     ENetEvent enet_event;
     
     enet_address_set_host(&address, server_addr.c_str());
     address.port = port;
-    ENetPeer *server {enet_host_connect(client, &address, num_channels, 0)};
-    if (server == NULL) {
-        std::cerr << "Failed to connect to peer" << std::endl;
-        std::exit(1);
-    }
-
-    if (enet_host_service(client, &enet_event, 5000) > 0 && enet_event.type == ENET_EVENT_TYPE_CONNECT) {
-        std::cout << "Connection to " << server_addr << ":" << address.port << " success" << std::endl;
-    } else {
-        enet_peer_reset(server);
-        std::cout << "Connection to " << server_addr << ":" << address.port << " failed" << std::endl;
-    }
+    // a match we were sent to can send us on again if its game started in the meantime, but not forever
+    for (int redirects {0}; redirects <= max_redirects; redirects++) {
+        // tells the server which compression codecs we understand
+        ENetPeer *server {enet_host_connect(client, &address, num_channels, compression_connect_data(compression_codec(client)))};
+        if (server == NULL) {
+            std::cerr << "Failed to connect to peer" << std::endl;
+            std::exit(1);
+        }
 
-    // get player data
-    Player this_player = get_this_player(client);
+        if (service_emulated_host(client, &enet_event, 5000) > 0 && enet_event.type == ENET_EVENT_TYPE_CONNECT) {
+            std::cout << "Connection to " << server_addr << ":" << address.port << " success" << std::endl;
+        } else {
+            enet_peer_reset(server);
+            std::cout << "Connection to " << server_addr << ":" << address.port << " failed" << std::endl;
+        }
 
-    // get previous game data
-    auto [players, obstacles] = get_previous_game_data(client);
-    return {this_player, players, obstacles, server};
+        // get player data, the rest of the world is streamed in afterwards
+        uint16_t redirect_port {0};
+        Player this_player = get_this_player(client, redirect_port);
+        if (redirect_port == 0)
+            return {this_player, server};
+        address.port = redirect_port;
+    }
+    std::cerr << "Every match on the server has already started" << std::endl;
+    std::exit(1);
 }
 
 int main(int argv, char **argc) {
-    if (enet_initialize() != 0) {
+    if (initialize_enet_with_pools(1) != 0) {
         std::cerr << "An error occurred while initializing Enet!" << std::endl;
         return 1;
     }
@@ -416,6 +496,33 @@ int main(int argv, char **argc) {
         std::cerr << "An error occured while creating ENetHost" << std::endl;
         return EXIT_FAILURE;
     }
+    CompressionCodec codec {CompressionCodec::LZ};
+    if (argv == 4 && !parse_compression_codec(argc[3], codec)) {
+        std::cerr << "Unknown compression codec " << argc[3] << ", expected none, range or lz" << std::endl;
+        return EXIT_FAILURE;
+    }
+    // spans are recorded if a file to write them to is given, it is written when F4 is pressed
+    trace_thread_name("render");
+    std::string trace_file_name;
+    if (const char *trace_file = std::getenv("LASTAND_TRACE")) {
+        trace_file_name = trace_file;
+        set_tracing(true);
+        std::cout << "Tracing, press F4 to write the trace to " << trace_file_name << std::endl;
+    }
+    if (!enable_compression(client, codec)) {
+        std::cerr << "Couldn't set up compression" << std::endl;
+        return EXIT_FAILURE;
+    }
+    // a lossy, laggy network is emulated if its conditions are given, see parse_network_conditions()
+    if (const char *netem = std::getenv("LASTAND_NETEM")) {
+        NetworkConditions conditions;
+        if (!parse_network_conditions(netem, conditions)) {
+            std::cerr << "Couldn't parse LASTAND_NETEM=" << netem << ", expected e.g. delay=80,jitter=20,loss=2,out.duplicate=1" << std::endl;
+            return EXIT_FAILURE;
+        }
+        enable_network_emulation(client, conditions);
+        std::cout << "Emulating network conditions: " << conditions << std::endl;
+    }
 
     if (!SDL_Init(SDL_INIT_VIDEO)) {
         std::cerr << "SDL failed to initialize: " << SDL_GetError() << std::endl;
@@ -453,7 +560,7 @@ int main(int argv, char **argc) {
     for (int i {0}; i < argv; i++)
         std::cout << argc[i] << std::endl;
 
-    if (argv == 3) {
+    if (argv == 3 || argv == 4) {
         server_addr = argc[1];
         port = std::stoi(argc[2]);
     } else if (argv == 2)
@@ -462,8 +569,12 @@ int main(int argv, char **argc) {
 
     std::pair<short, short> player_movement;
     std::vector<Projectile> projectiles;
-    std::vector<Particle> particles;
-    auto last_time = SDL_GetTicks();
+    ParticleSystem particles {max_particles};
+    BatchRenderer batch;
+    UsernameLabels username_labels;
+    SnapshotInterpolator interpolator;
+    FramePacer pacer {renderer, FramePacing::Capped, default_fps_cap};
+    PerfHud hud;
     ImVec4 player_color {1.0f, 1.0f, 1.0f, 1.0f};
     char username[15] = "";
     bool connected_to_server = false;
@@ -478,7 +589,10 @@ int main(int argv, char **argc) {
     Player local_player;
     std::map<int, Player> players;
     ENetPeer *server {nullptr};
+    // services the connection once connected
+    std::unique_ptr<NetworkThread> network;
     std::vector<Obstacle> obstacles;
+    WorldLoadState world;
 
     bool running = true;
     SDL_Event event;
@@ -486,17 +600,24 @@ int main(int argv, char **argc) {
     SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
 
     while (running) {
+        TRACE_SCOPE("frame");
+        float frame_seconds {pacer.begin_frame()};
+        hud.frame(frame_seconds);
         while (SDL_PollEvent(&event)) {
             ImGui_ImplSDL3_ProcessEvent(&event);
             if (event.type == SDL_EVENT_QUIT)
                 running = false;
             else if (event.type == SDL_EVENT_WINDOW_CLOSE_REQUESTED && event.window.windowID == SDL_GetWindowID(window))
                 running = false;
+            else if (event.type == SDL_EVENT_KEY_DOWN && event.key.scancode == SDL_SCANCODE_F3 && !event.key.repeat)
+                hud.visible = !hud.visible;
+            else if (event.type == SDL_EVENT_KEY_DOWN && event.key.scancode == SDL_SCANCODE_F4 && !event.key.repeat && tracing())
+                dump_trace(trace_file_name);
             else if (connected_to_server && players.find(local_player.id) != players.end()) {
                 auto last_movement = player_movement;
                 std::vector<uint8_t> data_to_send {process_event(event, player_movement, players.at(local_player.id).x, players.at(local_player.id).y)};
                 if (!data_to_send.empty() && (player_movement != last_movement || event.type == SDL_EVENT_MOUSE_BUTTON_UP)) {
-                    send_packet(server, data_to_send, channel_updates);
+                    network->send(std::move(data_to_send), channel_updates);
                 }
             }
         }
@@ -514,8 +635,10 @@ int main(int argv, char **argc) {
 
             if (ImGui::Button("Connect to the server")) {
                 connected_to_server = true;
-                std::tie(local_player, players, obstacles, server) = connect_to_server(client, server_addr, port);
+                std::tie(local_player, server) = connect_to_server(client, server_addr, port);
                 players[local_player.id] = local_player;
+                network = std::make_unique<NetworkThread>(client, server);
+                network->start();
                 // send username and color to server
                 std::vector<uint8_t> color_change {
                     static_cast<uint8_t>(MessageToServerTypes::SetClientAttributes),
@@ -525,56 +648,71 @@ int main(int argv, char **argc) {
                     static_cast<uint8_t>(player_color.z * 255),
                     static_cast<uint8_t>(player_color.w * 255)
                 };
-                send_packet(server, color_change, channel_user_updates);
+                network->send(std::move(color_change), channel_user_updates);
                 std::vector<uint8_t> username_change {
                     static_cast<uint8_t>(MessageToServerTypes::SetClientAttributes),
                     static_cast<uint8_t>(SetPlayerAttributesTypes::UsernameChanged),
                     static_cast<uint8_t>(strlen(username))
                 };
                 username_change.insert(username_change.end(), username, username + strlen(username));
-                send_packet(server, username_change, channel_user_updates);
+                network->send(std::move(username_change), channel_user_updates);
             }
             ImGui::End();
         } else {
-            ENetEvent enet_event;
-            while (enet_host_service(client, &enet_event, tick_rate_ms) > 0) {
-                switch (enet_event.type) {
-                    case ENET_EVENT_TYPE_RECEIVE: {
-                        std::vector<uint8_t> data;
-                        for (int i{0}; i < enet_event.packet->dataLength; i++)
-                            data.push_back(enet_event.packet->data[i]);
-                        std::cout << "Received data: " << data << " on channel: " << (int)enet_event.channelID << '\n';
-                        std::string new_event = parse_message_from_server(data, players, projectiles, particles);
-                        if (new_event != "") {
-                            latest_event = new_event;
-                            latest_event_time = SDL_GetTicks();
-                        }
-                        if (new_event == "The game has started!")
-                            game_started = true;
-                        if (data[0] == (uint8_t)MessageToClientTypes::PlayerWon) {
-                            player_won = {true, players.at(data[1]).username};
-
-                            // add a lot of explosions (otherwise known as particles)
-                            auto new_particles = create_particles<10>(players.at(data[1]).x / 2 + player_size, players.at(data[1]).y / 2 + player_size, 100);
-                            particles.insert(particles.end(), new_particles.begin(), new_particles.end());
-                            new_particles = create_particles<10>(0, 0, 50);
-                            particles.insert(particles.end(), new_particles.begin(), new_particles.end());
-                            new_particles = create_particles<10>(window_size, window_size, 50);
-                            particles.insert(particles.end(), new_particles.begin(), new_particles.end());
-                            new_particles = create_particles<10>(window_size, 0, 50);
-                            particles.insert(particles.end(), new_particles.begin(), new_particles.end());
-                            new_particles = create_particles<10>(0, window_size, 50);
-                            particles.insert(particles.end(), new_particles.begin(), new_particles.end());
-                        }
-                        break;
-                    }
-                    default:
-                        break;
+            std::vector<uint8_t> data;
+            bool positions_received {false};
+            while (network->receive(data)) {
+                TRACE_SCOPE("apply message");
+                positions_received |= data[0] == (uint8_t)MessageToClientTypes::UpdatePlayerPositions;
+                std::string new_event = parse_message_from_server(data, players, projectiles, particles, obstacles, world, username_labels);
+                if (new_event != "") {
+                    latest_event = new_event;
+                    latest_event_time = SDL_GetTicks();
+                }
+                if (world.request_map) {
+                    network->send(std::vector<uint8_t> {static_cast<uint8_t>(MessageToServerTypes::RequestMap)}, channel_user_updates);
+                    world.request_map = false;
+                }
+                if (new_event == "The game has started!")
+                    game_started = true;
+                size_t winner_idx {1};
+                PlayerId winner;
+                if (data[0] == (uint8_t)MessageToClientTypes::PlayerWon && deserialize_player_id(data, winner_idx, winner) && players.count(winner)) {
+                    player_won = {true, players.at(winner).username};
+
+                    // add a lot of explosions (otherwise known as particles)
+                    particles.emit(players.at(winner).x / 2 + player_size, players.at(winner).y / 2 + player_size, 10, 100);
+                    particles.emit(0, 0, 10, 50);
+                    particles.emit(window_size, window_size, 10, 50);
+                    particles.emit(window_size, 0, 10, 50);
+                    particles.emit(0, window_size, 10, 50);
                 }
             }
+            // once per frame, so the time between snapshots isn't thrown off by several arriving together
+            if (positions_received) {
+                interpolator.snapshot_received(players, pacer.frame_start_ns());
+                hud.snapshot_received(pacer.frame_start_ns());
+            }
             ImGui::Begin("Game", nullptr, ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove);
             ImGui::Text("Frame time: %.3f ms/frame (%.1f FPS)", 1000.0f / io.Framerate, io.Framerate);
+            if (network->server_disconnected())
+                ImGui::Text("Disconnected from the server");
+            const char *pacing_names[] {frame_pacing_name(FramePacing::VSync), frame_pacing_name(FramePacing::Capped), frame_pacing_name(FramePacing::Uncapped)};
+            int pacing {static_cast<int>(pacer.pacing())};
+            if (ImGui::Combo("Frame pacing", &pacing, pacing_names, 3))
+                pacer.set_pacing(static_cast<FramePacing>(pacing));
+            int fps_cap {static_cast<int>(pacer.fps_cap())};
+            if (pacer.pacing() == FramePacing::Capped && ImGui::SliderInt("FPS cap", &fps_cap, 30, 360))
+                pacer.set_fps_cap(fps_cap);
+            ImGui::Checkbox("Net/perf overlay (F3)", &hud.visible);
+            if (!world.complete())
+                ImGui::Text("Loading world: %d/%d map chunk(s) received", world.obstacle_chunks_received, world.map.num_chunks);
+            if (const CompressionStats &stats = network->stats().compression; stats.packets_decompressed > 0)
+                ImGui::Text("Compression (%s): ratio %.2f, %.2f us/packet decompressing", compression_codec_name(codec), stats.received_ratio(),
+                            stats.decompress_ns / 1000.0 / stats.packets_decompressed);
             ImGui::End();
+            auto local = players.find(local_player.id);
+            hud.draw(network->stats(), interpolator, local != players.end() ? &local->second : nullptr, SDL_GetTicksNS());
             ImGui::Begin("Events", nullptr, ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove);
             if (SDL_GetTicks() - latest_event_time < 5000)
                 ImGui::Text("%s", latest_event.c_str());
@@ -585,13 +723,13 @@ int main(int argv, char **argc) {
                 ImGui::Begin("Waiting for game to start", nullptr, ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoScrollbar | ImGuiWindowFlags_NoSavedSettings);
                 if (!is_ready && ImGui::Button("Ready to play?")) {
                     std::vector<uint8_t> ready_msg {static_cast<uint8_t>(MessageToServerTypes::ReadyUp)};
-                    send_packet(server, ready_msg, channel_user_updates);
+                    network->send(std::move(ready_msg), channel_user_updates);
                     is_ready = true;
                 } else if (is_ready) {
                     ImGui::Text("Waiting for other players to be ready...");
                     if (ImGui::Button("Unready")) {
                         std::vector<uint8_t> not_ready_msg {static_cast<uint8_t>(MessageToServerTypes::UnReady)};
-                        send_packet(server, not_ready_msg, channel_user_updates);
+                        network->send(std::move(not_ready_msg), channel_user_updates);
                         is_ready = false;
                     }
                 }
@@ -603,38 +741,50 @@ int main(int argv, char **argc) {
             }
         }
 
-        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-        SDL_RenderClear(renderer);
-
-        for (const auto &[id, player] : players) {
-            draw_player(renderer, player);
-            draw_player_username(player, username_font);
-        }
+        {
+            TRACE_SCOPE("render");
+            SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+            SDL_RenderClear(renderer);
+
+            // a shadow and a body per player
+            batch.reserve(players.size() * 2 + obstacles.size() + projectiles.size() + particles.size());
+            uint64_t now_ns {SDL_GetTicksNS()};
+            for (const auto &[id, player] : players)
+                draw_player(batch, player, interpolator.position(player, now_ns));
+            draw_player_usernames(username_labels, players, interpolator, now_ns, username_font);
         
-        for (const auto &obstacle : obstacles)
-            draw_obstacle(renderer, obstacle);
+            for (const auto &obstacle : obstacles)
+                draw_obstacle(batch, obstacle);
 
-        for (auto p : projectiles)
-            draw_projectile(renderer, p);
+            for (const auto &p : projectiles)
+                draw_projectile(batch, p);
 
-        update_particles(particles);
-        draw_particles(renderer, particles);
+            particles.update(frame_seconds);
+            particles.draw(batch);
+            batch.flush(renderer);
 
-        SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-        SDL_RenderLine(renderer, 0, window_size, window_size, window_size);
+            SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+            SDL_RenderLine(renderer, 0, window_size, window_size, window_size);
 
-        ImGui::Render();
-        ImGui_ImplSDLRenderer3_RenderDrawData(ImGui::GetDrawData(), renderer);
+            ImGui::Render();
+            ImGui_ImplSDLRenderer3_RenderDrawData(ImGui::GetDrawData(), renderer);
+        }
 
-        SDL_RenderPresent(renderer);
-        if (SDL_GetTicks() - last_time < tick_rate_ms)
-            SDL_Delay(tick_rate_ms - (SDL_GetTicks() - last_time));
+        {
+            TRACE_SCOPE("present");
+            SDL_RenderPresent(renderer);
+        }
+        pacer.end_frame();
     }
 
 
-    enet_peer_disconnect(server, 0);
+    // the host is only used from this thread again after this
+    if (network)
+        network->stop();
+    if (server)
+        enet_peer_disconnect(server, 0);
     ENetEvent enet_event;
-    while (enet_host_service(client, &enet_event, 500) > 0) {
+    while (service_emulated_host(client, &enet_event, 500) > 0) {
         switch (enet_event.type) {
             case ENET_EVENT_TYPE_RECEIVE:
                 enet_packet_destroy(enet_event.packet);
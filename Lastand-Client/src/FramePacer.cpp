@@ -0,0 +1,76 @@
+#include "FramePacer.h"
+#include <algorithm>
+#include <iostream>
+#include "Trace.h"
+
+// the spin margin starts here and follows how much sleeps actually overshoot
+constexpr uint64_t initial_oversleep_ns {1'000'000};
+constexpr uint64_t max_oversleep_ns {4'000'000};
+// frames this late give up catching up and start counting again from now
+constexpr uint64_t max_frames_behind {2};
+
+const char *frame_pacing_name(FramePacing pacing) {
+    switch (pacing) {
+        case FramePacing::VSync:
+            return "VSync";
+        case FramePacing::Capped:
+            return "Capped";
+        case FramePacing::Uncapped:
+            return "Uncapped";
+    }
+    return "?";
+}
+
+FramePacer::FramePacer(SDL_Renderer *renderer, FramePacing pacing, uint32_t fps_cap):
+    renderer {renderer}, current_pacing {FramePacing::Uncapped}, cap {std::max<uint32_t>(fps_cap, 1)}, oversleep_ns {initial_oversleep_ns} {
+    frame_start = SDL_GetTicksNS();
+    set_pacing(pacing);
+}
+
+void FramePacer::set_pacing(FramePacing pacing) {
+    if (pacing == current_pacing)
+        return;
+    if (!SDL_SetRenderVSync(renderer, pacing == FramePacing::VSync ? 1 : SDL_RENDERER_VSYNC_DISABLED)) {
+        std::cerr << "Error in SDL_SetRenderVSync: " << SDL_GetError() << std::endl;
+        if (pacing == FramePacing::VSync)
+            pacing = FramePacing::Capped;
+    }
+    current_pacing = pacing;
+    next_frame = 0;
+}
+
+void FramePacer::set_fps_cap(uint32_t fps_cap) {
+    cap = std::max<uint32_t>(fps_cap, 1);
+    next_frame = 0;
+}
+
+float FramePacer::begin_frame() {
+    uint64_t now {SDL_GetTicksNS()};
+    float dt {(now - frame_start) / 1e9f};
+    frame_start = now;
+    return dt;
+}
+
+void FramePacer::end_frame() {
+    if (current_pacing != FramePacing::Capped)
+        return;
+    TRACE_SCOPE("wait for next frame");
+    uint64_t period {static_cast<uint64_t>(SDL_NS_PER_SECOND) / cap};
+    uint64_t now {SDL_GetTicksNS()};
+    if (next_frame == 0 || now > next_frame + period * max_frames_behind)
+        next_frame = now;
+    next_frame += period;
+    if (now >= next_frame)
+        return;
+
+    uint64_t remaining {next_frame - now};
+    if (remaining > oversleep_ns) {
+        uint64_t asked {remaining - oversleep_ns};
+        SDL_DelayNS(asked);
+        uint64_t slept {SDL_GetTicksNS() - now};
+        // remembers the worst recent overshoot, slowly forgetting it
+        uint64_t overshoot {slept > asked ? slept - asked : 0};
+        oversleep_ns = std::min(max_oversleep_ns, std::max(overshoot, oversleep_ns - oversleep_ns / 64));
+    }
+    while (SDL_GetTicksNS() < next_frame) {}
+}
@@ -0,0 +1,49 @@
+#pragma once
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <cstdint>
+#include <SDL3/SDL.h>
+
+enum class FramePacing {
+    // wait for the display in SDL_RenderPresent()
+    VSync,
+    // at most fps_cap frames a second, timed in nanoseconds
+    Capped,
+    // as many frames as possible
+    Uncapped
+};
+
+const char *frame_pacing_name(FramePacing pacing);
+
+// Decides when the next frame starts. A capped frame sleeps for most of the time it has left
+// and spins for the rest, since sleeps can overshoot by a millisecond or more, which is a lot
+// of a frame at high frame rates.
+class FramePacer {
+public:
+    FramePacer(SDL_Renderer *renderer, FramePacing pacing, uint32_t fps_cap);
+
+    void set_pacing(FramePacing pacing);
+    void set_fps_cap(uint32_t fps_cap);
+    FramePacing pacing() const { return current_pacing; }
+    uint32_t fps_cap() const { return cap; }
+
+    // call at the start of every frame, returns the wall clock time since the start of the last one in seconds
+    float begin_frame();
+    // call after SDL_RenderPresent(), waits until the next frame should start
+    void end_frame();
+
+    uint64_t frame_start_ns() const { return frame_start; }
+
+private:
+    SDL_Renderer *renderer;
+    FramePacing current_pacing;
+    uint32_t cap;
+    uint64_t frame_start {0};
+    // when the next capped frame is due, following the cap exactly instead of drifting with each frame's lateness
+    uint64_t next_frame {0};
+    // how much longer than asked sleeps have been taking, spun through instead of slept
+    uint64_t oversleep_ns;
+};
+
+#endif // FRAME_PACER_H
@@ -0,0 +1,146 @@
+#include "NetworkThread.h"
+#include <chrono>
+#include <iostream>
+#include "constants.h"
+#include "NetworkEmulator.h"
+#include "serialize.h"
+#include "Trace.h"
+#include "utils.h"
+
+// how long the network thread waits for packets before looking at the outgoing queue again
+constexpr uint32_t service_timeout_ms {1};
+// how often the stats are copied out for the render thread
+constexpr uint64_t stats_interval_ns {250'000'000};
+
+NetworkThread::NetworkThread(ENetHost *host, ENetPeer *server): host {host}, server {server} {}
+
+NetworkThread::~NetworkThread() {
+    stop();
+}
+
+void NetworkThread::start() {
+    if (running.exchange(true))
+        return;
+    thread = std::thread(&NetworkThread::run, this);
+}
+
+void NetworkThread::stop() {
+    running.store(false, std::memory_order_release);
+    if (thread.joinable())
+        thread.join();
+}
+
+void NetworkThread::send(std::vector<uint8_t> message, int channel_id) {
+    // keeps the order, nothing can overtake the messages already waiting in the backlog
+    while (!outbound_backlog.empty() && outbound.try_push(std::move(outbound_backlog.front())))
+        outbound_backlog.pop_front();
+    OutgoingMessage outgoing {channel_id, std::move(message)};
+    if (!outbound_backlog.empty() || !outbound.try_push(std::move(outgoing)))
+        outbound_backlog.push_back(std::move(outgoing));
+}
+
+bool NetworkThread::receive(std::vector<uint8_t> &message) {
+    return inbound.try_pop(message);
+}
+
+const NetworkStats &NetworkThread::stats() {
+    while (published_stats.try_pop(latest_stats)) {}
+    return latest_stats;
+}
+
+void NetworkThread::run() {
+    trace_thread_name("network");
+    ENetEvent event;
+    bool keep_running {true};
+    while (keep_running) {
+        // the last messages queued before stop() still get sent
+        keep_running = running.load(std::memory_order_acquire);
+        send_outgoing();
+        while (!inbound_backlog.empty() && inbound.try_push(std::move(inbound_backlog.front())))
+            inbound_backlog.pop_front();
+
+        int result;
+        {
+            TRACE_SCOPE("enet_host_service");
+            result = service_emulated_host(host, &event, keep_running ? service_timeout_ms : 0);
+        }
+        for (; result > 0; result = enet_host_check_events(host, &event)) {
+            switch (event.type) {
+                case ENET_EVENT_TYPE_RECEIVE:
+                    handle_packet(event.packet, event.channelID);
+                    enet_packet_destroy(event.packet);
+                    break;
+                case ENET_EVENT_TYPE_DISCONNECT:
+                    std::cout << "Disconnected by the server" << std::endl;
+                    disconnected.store(true, std::memory_order_release);
+                    break;
+                default:
+                    break;
+            }
+        }
+        if (result < 0)
+            std::cerr << "Failed to service the connection to the server" << std::endl;
+        publish_stats();
+    }
+    enet_host_flush(host);
+}
+
+void NetworkThread::send_outgoing() {
+    OutgoingMessage message;
+    while (outbound.try_pop(message)) {
+        ENetPacket *packet = enet_packet_create(message.data.data(), message.data.size(), ENET_PACKET_FLAG_RELIABLE);
+        int val = enet_peer_send(server, message.channel_id, packet);
+        if (val != 0) {
+            std::cerr << "Failed to send packet: " << val << std::endl;
+            enet_packet_destroy(packet);
+        }
+    }
+}
+
+void NetworkThread::publish_stats() {
+    uint64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    if (now_ns - last_published_ns < stats_interval_ns)
+        return;
+    last_published_ns = now_ns;
+    NetworkStats stats {counters};
+    stats.time_ns = now_ns;
+    if (const CompressionStats *compression = compression_stats(host))
+        stats.compression = *compression;
+    if (const NetworkEmulationStats *emulation = network_emulation_stats(host)) {
+        stats.emulating = true;
+        stats.emulation = *emulation;
+    }
+    stats.rtt_ms = server->roundTripTime;
+    stats.rtt_variance_ms = server->roundTripTimeVariance;
+    stats.packet_loss = static_cast<double>(server->packetLoss) / ENET_PEER_PACKET_LOSS_SCALE;
+    stats.packets_received = host->totalReceivedPackets;
+    stats.bytes_received = host->totalReceivedData;
+    stats.packets_sent = host->totalSentPackets;
+    stats.bytes_sent = host->totalSentData;
+    // dropped if the render thread hasn't picked up the last ones yet, it gets the next ones
+    published_stats.try_push(std::move(stats));
+}
+
+void NetworkThread::handle_packet(const ENetPacket *packet, [[maybe_unused]] uint8_t channel_id) {
+    TRACE_SCOPE("unpack packet");
+    std::vector<uint8_t> packet_data {packet->data, packet->data + packet->dataLength};
+#ifdef DEBUG
+    std::cout << "Received data: " << packet_data << " on channel: " << (int)channel_id << '\n';
+#endif
+    // the server packs the messages of a tick into bundles
+    std::vector<std::vector<uint8_t>> messages;
+    if (!packet_data.empty() && packet_data[0] == (uint8_t)MessageToClientTypes::Bundle) {
+        if (!deserialize_bundle({packet_data.begin() + 1, packet_data.end()}, messages))
+            std::cerr << "Received a malformed bundle" << std::endl;
+    } else if (!packet_data.empty()) {
+        messages.push_back(std::move(packet_data));
+    }
+    for (auto &message : messages) {
+        if (message[0] < num_message_to_client_types) {
+            counters.messages_by_type[message[0]]++;
+            counters.bytes_by_type[message[0]] += message.size();
+        }
+        if (!inbound_backlog.empty() || !inbound.try_push(std::move(message)))
+            inbound_backlog.push_back(std::move(message));
+    }
+}
@@ -0,0 +1,90 @@
+#pragma once
+#ifndef NETWORK_THREAD_H
+#define NETWORK_THREAD_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <thread>
+#include <vector>
+#include <enet/enet.h>
+#include "Compression.h"
+#include "NetworkEmulator.h"
+#include "SpscQueue.h"
+#include "serialize.h"
+
+constexpr size_t num_message_to_client_types {static_cast<size_t>(MessageToClientTypes::Bundle) + 1};
+
+// what the network thread knows about the connection, copied out for the render thread every now and then
+struct NetworkStats {
+    // steady clock time the stats were taken at
+    uint64_t time_ns {0};
+    CompressionStats compression;
+    // what the network emulator did to the datagrams, if LASTAND_NETEM is set
+    bool emulating {false};
+    NetworkEmulationStats emulation;
+    // from the server's ENetPeer, the round trip time and its mean deviation (the jitter)
+    uint32_t rtt_ms {0};
+    uint32_t rtt_variance_ms {0};
+    double packet_loss {0.0};
+    // totals from the ENetHost, of the datagrams on the wire
+    uint32_t packets_received {0};
+    uint32_t bytes_received {0};
+    uint32_t packets_sent {0};
+    uint32_t bytes_sent {0};
+    // messages from the server after unbundling them, by MessageToClientTypes
+    std::array<uint64_t, num_message_to_client_types> messages_by_type {};
+    std::array<uint64_t, num_message_to_client_types> bytes_by_type {};
+};
+
+// Services the connection to the server on its own thread, so the render loop never waits for packets.
+// Received packets are split into messages (bundles are unpacked) and handed to the render thread through
+// one lock-free queue, and the messages the render thread sends go to the network thread through another.
+// After start() only the network thread touches the ENetHost, until stop() returns.
+class NetworkThread {
+public:
+    NetworkThread(ENetHost *host, ENetPeer *server);
+    ~NetworkThread();
+
+    void start();
+    // waits for the thread to finish, anything still queued to be sent is sent first
+    void stop();
+
+    // render thread side. Messages are sent reliably on the given channel, in the order they were sent
+    void send(std::vector<uint8_t> message, int channel_id);
+    // the next message from the server, false if there are none right now
+    bool receive(std::vector<uint8_t> &message);
+    bool server_disconnected() const { return disconnected.load(std::memory_order_acquire); }
+    // the latest stats published by the network thread
+    const NetworkStats &stats();
+
+private:
+    struct OutgoingMessage {
+        int channel_id;
+        std::vector<uint8_t> data;
+    };
+
+    void run();
+    void send_outgoing();
+    void handle_packet(const ENetPacket *packet, uint8_t channel_id);
+    void publish_stats();
+
+    ENetHost *host;
+    ENetPeer *server;
+    SpscQueue<std::vector<uint8_t>> inbound {4096};
+    SpscQueue<OutgoingMessage> outbound {256};
+    // messages that didn't fit in a full queue wait here, each only used by the thread pushing to the queue
+    std::deque<std::vector<uint8_t>> inbound_backlog;
+    std::deque<OutgoingMessage> outbound_backlog;
+    SpscQueue<NetworkStats> published_stats {4};
+    NetworkStats latest_stats;
+    // the network thread's own copy, counting the messages as they arrive
+    NetworkStats counters;
+    uint64_t last_published_ns {0};
+    std::atomic<bool> running {false};
+    std::atomic<bool> disconnected {false};
+    std::thread thread;
+};
+
+#endif // NETWORK_THREAD_H
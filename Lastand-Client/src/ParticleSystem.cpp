@@ -0,0 +1,53 @@
+#include "ParticleSystem.h"
+#include "constants.h"
+
+// particles used to move and age once per frame, at the tick rate. These keep them looking the same
+constexpr float frames_per_second {static_cast<float>(1000.0 / tick_rate_ms)};
+constexpr float seconds_per_life {1 / (0.2f * frames_per_second)};
+
+constexpr float particle_size {3.0};
+
+ParticleSystem::ParticleSystem(size_t capacity):
+    x(capacity), y(capacity), dx(capacity), dy(capacity), life_left(capacity), color(capacity) {}
+
+void ParticleSystem::emit(float start_x, float start_y, size_t n, float life) {
+    for (size_t i {0}; i < n && count < capacity(); i++, count++) {
+        x[count] = start_x;
+        y[count] = start_y;
+        dx[count] = (SDL_rand(6) - 3) * frames_per_second;
+        dy[count] = (SDL_rand(6) - 3) * frames_per_second;
+        life_left[count] = (life < 0 ? SDL_rand(15) + 5 : life) * seconds_per_life;
+        color[count] = {static_cast<Uint8>(SDL_rand(155) + 100), static_cast<Uint8>(SDL_rand(155) + 30), 0, 255};
+    }
+}
+
+void ParticleSystem::update(float dt) {
+    float *px {x.data()}, *py {y.data()}, *life {life_left.data()};
+    const float *pdx {dx.data()}, *pdy {dy.data()};
+    for (size_t i {0}; i < count; i++)
+        px[i] += pdx[i] * dt;
+    for (size_t i {0}; i < count; i++)
+        py[i] += pdy[i] * dt;
+    for (size_t i {0}; i < count; i++)
+        life[i] -= dt;
+
+    for (size_t i {0}; i < count;) {
+        if (life[i] > 0) {
+            i++;
+            continue;
+        }
+        // the last particle takes the dead one's place and is looked at next
+        count--;
+        x[i] = x[count];
+        y[i] = y[count];
+        dx[i] = dx[count];
+        dy[i] = dy[count];
+        life_left[i] = life_left[count];
+        color[i] = color[count];
+    }
+}
+
+void ParticleSystem::draw(BatchRenderer &batch) const {
+    for (size_t i {0}; i < count; i++)
+        batch.add_rect({x[i], y[i], particle_size, particle_size}, color[i]);
+}
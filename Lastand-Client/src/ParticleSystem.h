@@ -0,0 +1,36 @@
+#pragma once
+#ifndef PARTICLE_SYSTEM_H
+#define PARTICLE_SYSTEM_H
+
+#include <cstddef>
+#include <vector>
+#include <SDL3/SDL.h>
+#include "BatchRenderer.h"
+
+// A fixed number of particles kept as one array per field, so update() is a few loops over
+// contiguous floats the compiler can vectorize. A dead particle is replaced by the last live one,
+// and particles emitted while the pool is full are dropped, so nothing is allocated after construction.
+//
+// Speeds are in pixels per second and lifetimes in seconds, so particles move the same no matter the frame rate.
+class ParticleSystem {
+public:
+    explicit ParticleSystem(size_t capacity);
+
+    // adds count particles flying out of (x, y) in random directions, living life seconds (a random time if negative)
+    void emit(float x, float y, size_t count, float life = -1);
+    // moves the particles by dt seconds and removes the ones that died
+    void update(float dt);
+    void draw(BatchRenderer &batch) const;
+
+    size_t size() const { return count; }
+    size_t capacity() const { return x.size(); }
+
+private:
+    size_t count {0};
+    std::vector<float> x, y;
+    std::vector<float> dx, dy;
+    std::vector<float> life_left;
+    std::vector<SDL_Color> color;
+};
+
+#endif // PARTICLE_SYSTEM_H
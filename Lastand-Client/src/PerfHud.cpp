@@ -0,0 +1,130 @@
+#include "PerfHud.h"
+#include <algorithm>
+#include "imgui.h"
+#include "PacketPool.h"
+
+// how long the rates are averaged over
+constexpr uint64_t rate_interval_ns {1'000'000'000};
+
+static const char *message_type_names[num_message_to_client_types] {
+    "UpdatePlayerPositions",
+    "SetPlayerAttributes",
+    "PlayerKilled",
+    "PlayerLeft",
+    "PlayerJoined",
+    "PlayerWon",
+    "PreviousGameData",
+    "UpdateProjectiles",
+    "GameStarted",
+    "WorldChunk",
+    "WorldComplete",
+    "MapInfo",
+    "Bundle",
+};
+
+void PerfHud::History::add(float value) {
+    values[next] = value;
+    next = (next + 1) % history_size;
+}
+
+float PerfHud::History::max() const {
+    return *std::max_element(values.begin(), values.end());
+}
+
+void PerfHud::frame(float frame_seconds) {
+    frame_ms.add(frame_seconds * 1000);
+}
+
+void PerfHud::snapshot_received(uint64_t now_ns) {
+    if (last_snapshot_ns != 0)
+        snapshot_interval_ms.add((now_ns - last_snapshot_ns) / 1e6f);
+    last_snapshot_ns = now_ns;
+}
+
+void PerfHud::update_rates(const NetworkStats &stats) {
+    if (stats.time_ns < rate_start.time_ns + rate_interval_ns)
+        return;
+    if (rate_start.time_ns != 0) {
+        double seconds {(stats.time_ns - rate_start.time_ns) / 1e9};
+        // ENet's totals are 32 bits and wrap around
+        rates.packets_received = static_cast<uint32_t>(stats.packets_received - rate_start.packets_received) / seconds;
+        rates.bytes_received = static_cast<uint32_t>(stats.bytes_received - rate_start.bytes_received) / seconds;
+        rates.packets_sent = static_cast<uint32_t>(stats.packets_sent - rate_start.packets_sent) / seconds;
+        rates.bytes_sent = static_cast<uint32_t>(stats.bytes_sent - rate_start.bytes_sent) / seconds;
+        for (size_t i {0}; i < num_message_to_client_types; i++) {
+            rates.messages_by_type[i] = (stats.messages_by_type[i] - rate_start.messages_by_type[i]) / seconds;
+            rates.bytes_by_type[i] = (stats.bytes_by_type[i] - rate_start.bytes_by_type[i]) / seconds;
+        }
+    }
+    rate_start = stats;
+}
+
+void PerfHud::draw(const NetworkStats &stats, const SnapshotInterpolator &interpolator, const Player *local_player, uint64_t now_ns) {
+    update_rates(stats);
+    if (!visible)
+        return;
+
+    ImGui::SetNextWindowBgAlpha(0.6f);
+    ImGui::Begin("Net/perf (F3)", &visible, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoSavedSettings);
+
+    ImGui::PlotLines("Frame time", frame_ms.values.data(), history_size, frame_ms.next, nullptr, 0.0f,
+                     std::max(frame_ms.max(), 20.0f), ImVec2(240, 50));
+    ImGui::PlotLines("Snapshot interval", snapshot_interval_ms.values.data(), history_size, snapshot_interval_ms.next, nullptr, 0.0f,
+                     std::max(snapshot_interval_ms.max(), 20.0f), ImVec2(240, 50));
+
+    ImGui::Text("RTT: %u ms, jitter: %u ms, loss: %.1f%%", stats.rtt_ms, stats.rtt_variance_ms, stats.packet_loss * 100);
+    ImGui::Text("Snapshot age: %.1f ms, interpolation delay: %.1f ms", interpolator.snapshot_age_ms(now_ns), interpolator.delay_ms());
+    if (local_player)
+        ImGui::Text("Interpolation error: %.1f units", interpolator.error(*local_player, now_ns));
+    ImGui::Text("Received: %.0f packets/s, %.1f KB/s", rates.packets_received, rates.bytes_received / 1024);
+    ImGui::Text("Sent: %.0f packets/s, %.1f KB/s", rates.packets_sent, rates.bytes_sent / 1024);
+    if (stats.compression.packets_decompressed > 0)
+        ImGui::Text("Compression: ratio %.2f", stats.compression.received_ratio());
+    if (stats.emulating)
+        ImGui::Text("Emulated: %llu/%llu in and %llu/%llu out dropped, %llu/%llu held",
+                    static_cast<unsigned long long>(stats.emulation.in.dropped), static_cast<unsigned long long>(stats.emulation.in.datagrams),
+                    static_cast<unsigned long long>(stats.emulation.out.dropped), static_cast<unsigned long long>(stats.emulation.out.datagrams),
+                    static_cast<unsigned long long>(stats.emulation.in.held), static_cast<unsigned long long>(stats.emulation.out.held));
+
+    if (ImGui::BeginTable("Messages", 3, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit)) {
+        ImGui::TableSetupColumn("Message");
+        ImGui::TableSetupColumn("Messages/s");
+        ImGui::TableSetupColumn("Bytes/s");
+        ImGui::TableHeadersRow();
+        for (size_t i {0}; i < num_message_to_client_types; i++) {
+            if (stats.messages_by_type[i] == 0)
+                continue;
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Text("%s", message_type_names[i]);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", rates.messages_by_type[i]);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.0f", rates.bytes_by_type[i]);
+        }
+        ImGui::EndTable();
+    }
+
+    PacketPoolStats pools {packet_pool_stats()};
+    if (ImGui::BeginTable("Packet pools", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit)) {
+        ImGui::TableSetupColumn("Pool");
+        ImGui::TableSetupColumn("In use");
+        ImGui::TableSetupColumn("Peak");
+        ImGui::TableSetupColumn("Blocks");
+        ImGui::TableHeadersRow();
+        for (const auto &c : pools.classes) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Text("%zu B", c.block_size);
+            ImGui::TableNextColumn();
+            ImGui::Text("%llu", static_cast<unsigned long long>(c.in_use));
+            ImGui::TableNextColumn();
+            ImGui::Text("%llu", static_cast<unsigned long long>(c.peak_in_use));
+            ImGui::TableNextColumn();
+            ImGui::Text("%llu", static_cast<unsigned long long>(c.blocks));
+        }
+        ImGui::EndTable();
+    }
+    ImGui::Text("Too big for the pools: %llu", static_cast<unsigned long long>(pools.large_allocations));
+    ImGui::End();
+}
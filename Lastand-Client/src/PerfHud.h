@@ -0,0 +1,50 @@
+#pragma once
+#ifndef PERF_HUD_H
+#define PERF_HUD_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "NetworkThread.h"
+#include "Player.h"
+#include "SnapshotInterpolator.h"
+
+// An overlay with what's needed to tell a slow connection from a slow frame when someone reports lag:
+// frame and snapshot interval graphs, the round trip time and jitter to the server, how many packets
+// and bytes of each message type arrive per second, and how old and how delayed the drawn snapshot is.
+class PerfHud {
+public:
+    // call once per frame
+    void frame(float frame_seconds);
+    // call when a snapshot of the player positions has been applied
+    void snapshot_received(uint64_t now_ns);
+    // local_player is nullptr before the server has sent it
+    void draw(const NetworkStats &stats, const SnapshotInterpolator &interpolator, const Player *local_player, uint64_t now_ns);
+
+    bool visible {false};
+
+private:
+    static constexpr size_t history_size {240};
+    struct History {
+        std::array<float, history_size> values {};
+        size_t next {0};
+
+        void add(float value);
+        float max() const;
+    };
+
+    History frame_ms;
+    History snapshot_interval_ms;
+    uint64_t last_snapshot_ns {0};
+
+    // per second rates are worked out from the stats of about a second ago
+    NetworkStats rate_start;
+    struct Rates {
+        double packets_received {0}, bytes_received {0}, packets_sent {0}, bytes_sent {0};
+        std::array<double, num_message_to_client_types> messages_by_type {};
+        std::array<double, num_message_to_client_types> bytes_by_type {};
+    } rates;
+    void update_rates(const NetworkStats &stats);
+};
+
+#endif // PERF_HUD_H
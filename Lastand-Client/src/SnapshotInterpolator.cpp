@@ -0,0 +1,48 @@
+#include "SnapshotInterpolator.h"
+#include <algorithm>
+#include <cmath>
+
+// gaps longer than this are players standing still (nothing to send), not the snapshot rate
+constexpr uint64_t max_snapshot_interval_ns {250'000'000};
+
+void SnapshotInterpolator::snapshot_received(const std::map<int, Player> &players, uint64_t now_ns) {
+    float t {progress(now_ns)};
+    std::map<int, Motion> new_motions;
+    for (const auto &[id, player] : players) {
+        SDL_FPoint to {static_cast<float>(player.x), static_cast<float>(player.y)};
+        auto motion = motions.find(id);
+        if (motion == motions.end()) {
+            new_motions[id] = {to, to};
+            continue;
+        }
+        // carries on from where the player is drawn now
+        const Motion &m {motion->second};
+        new_motions[id] = {{m.from.x + (m.to.x - m.from.x) * t, m.from.y + (m.to.y - m.from.y) * t}, to};
+    }
+    motions = std::move(new_motions);
+    // the interval is only known after the interpolation of the last snapshot is done with it
+    if (last_snapshot_ns != 0 && now_ns - last_snapshot_ns < max_snapshot_interval_ns)
+        interval_ns = interval_ns * 0.9 + (now_ns - last_snapshot_ns) * 0.1;
+    last_snapshot_ns = now_ns;
+}
+
+SDL_FPoint SnapshotInterpolator::position(const Player &p, uint64_t now_ns) const {
+    auto motion = motions.find(p.id);
+    // a player that joined since the last snapshot, or a position that changed some other way
+    if (motion == motions.end() || motion->second.to.x != p.x || motion->second.to.y != p.y)
+        return {static_cast<float>(p.x), static_cast<float>(p.y)};
+    const Motion &m {motion->second};
+    float t {progress(now_ns)};
+    return {m.from.x + (m.to.x - m.from.x) * t, m.from.y + (m.to.y - m.from.y) * t};
+}
+
+float SnapshotInterpolator::error(const Player &p, uint64_t now_ns) const {
+    SDL_FPoint drawn {position(p, now_ns)};
+    return std::hypot(drawn.x - p.x, drawn.y - p.y);
+}
+
+float SnapshotInterpolator::progress(uint64_t now_ns) const {
+    if (now_ns <= last_snapshot_ns)
+        return 0;
+    return static_cast<float>(std::min(1.0, (now_ns - last_snapshot_ns) / interval_ns));
+}
@@ -0,0 +1,43 @@
+#pragma once
+#ifndef SNAPSHOT_INTERPOLATOR_H
+#define SNAPSHOT_INTERPOLATOR_H
+
+#include <cstdint>
+#include <map>
+#include <SDL3/SDL.h>
+#include "Player.h"
+#include "constants.h"
+
+// Moves the drawn players smoothly between the positions the server sends, by wall clock time instead
+// of jumping once per snapshot. When a snapshot arrives each player starts moving from where it is drawn
+// to its new position, getting there after about the time between snapshots, so players are drawn
+// that much behind the latest snapshot.
+class SnapshotInterpolator {
+public:
+    // call after the positions in a snapshot have been applied to players
+    void snapshot_received(const std::map<int, Player> &players, uint64_t now_ns);
+    // where to draw the player, in game coordinates
+    SDL_FPoint position(const Player &p, uint64_t now_ns) const;
+
+    // distance between where the player is drawn and its latest position, in game units
+    float error(const Player &p, uint64_t now_ns) const;
+
+    // how far behind the latest snapshot players are drawn
+    double delay_ms() const { return interval_ns / 1e6; }
+    // time since the last snapshot arrived
+    double snapshot_age_ms(uint64_t now_ns) const { return last_snapshot_ns ? (now_ns - last_snapshot_ns) / 1e6 : 0.0; }
+
+private:
+    struct Motion {
+        SDL_FPoint from;
+        SDL_FPoint to;
+    };
+    float progress(uint64_t now_ns) const;
+
+    std::map<int, Motion> motions;
+    uint64_t last_snapshot_ns {0};
+    // smoothed time between snapshots
+    double interval_ns {tick_rate_ms * 1e6};
+};
+
+#endif // SNAPSHOT_INTERPOLATOR_H
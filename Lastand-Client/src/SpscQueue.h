@@ -0,0 +1,54 @@
+#pragma once
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// A bounded queue between exactly one producer thread and one consumer thread, without locks.
+// The producer only writes tail and the consumer only writes head, so each side just needs to
+// see the other's index with acquire/release ordering.
+template <typename T>
+class SpscQueue {
+public:
+    // capacity is rounded up to a power of two
+    explicit SpscQueue(size_t capacity): slots(round_up(capacity)), mask {slots.size() - 1} {}
+
+    // producer side, returns false (and leaves value alone) if the queue is full
+    bool try_push(T &&value) {
+        size_t t {tail.load(std::memory_order_relaxed)};
+        if (t - head.load(std::memory_order_acquire) == slots.size())
+            return false;
+        slots[t & mask] = std::move(value);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side, returns false if the queue is empty
+    bool try_pop(T &value) {
+        size_t h {head.load(std::memory_order_relaxed)};
+        if (h == tail.load(std::memory_order_acquire))
+            return false;
+        value = std::move(slots[h & mask]);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    static size_t round_up(size_t capacity) {
+        size_t size {1};
+        while (size < capacity)
+            size <<= 1;
+        return size;
+    }
+
+    std::vector<T> slots;
+    size_t mask;
+    // on their own cache lines so the two threads don't keep taking the line from each other
+    alignas(64) std::atomic<size_t> head {0};
+    alignas(64) std::atomic<size_t> tail {0};
+};
+
+#endif // SPSC_QUEUE_H
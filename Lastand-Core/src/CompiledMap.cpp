@@ -0,0 +1,362 @@
+#include "CompiledMap.h"
+#include "serialize.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <utility>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // _WIN32
+
+uint64_t hash_obstacles(const std::vector<Obstacle> &obstacles) {
+    uint64_t hash {fnv1a_64(nullptr, 0)};
+    for (const auto &o : obstacles) {
+        auto data = serialize_obstacle(o);
+        hash = fnv1a_64(data.data(), data.size(), hash);
+    }
+    return hash;
+}
+
+static uint64_t align_to(uint64_t offset, uint64_t alignment) {
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+template <typename T>
+static void write_array(std::vector<uint8_t> &out, uint64_t offset, const std::vector<T> &values) {
+    if (!values.empty())
+        std::memcpy(out.data() + offset, values.data(), values.size() * sizeof(T));
+}
+
+std::vector<uint8_t> compile_map(const std::vector<Obstacle> &obstacles) {
+    uint32_t count = static_cast<uint32_t>(obstacles.size());
+    std::vector<uint16_t> xs, ys, widths, heights;
+    std::vector<Color> colors;
+    for (const auto &o : obstacles) {
+        xs.push_back(o.x);
+        ys.push_back(o.y);
+        widths.push_back(o.width);
+        heights.push_back(o.height);
+        colors.push_back(o.color);
+    }
+
+    // obstacles are grown by 1 unit on each side because a player corner within 1 unit
+    // of an edge touches it (see detect_collision())
+    auto first_cell = [](int v) { return static_cast<uint32_t>(std::max(v - 1, 0)) / compiled_map_cell_size; };
+    auto last_cell = [](int v) { return static_cast<uint32_t>(v + 1) / compiled_map_cell_size; };
+
+    uint32_t grid_width {1}, grid_height {1};
+    for (const auto &o : obstacles) {
+        grid_width = std::max(grid_width, last_cell(o.x + o.width * 2) + 1);
+        grid_height = std::max(grid_height, last_cell(o.y + o.height * 2) + 1);
+    }
+
+    std::vector<std::vector<uint32_t>> cells(grid_width * grid_height);
+    for (uint32_t i {0}; i < count; i++) {
+        const auto &o = obstacles[i];
+        for (uint32_t cy {first_cell(o.y)}; cy <= last_cell(o.y + o.height * 2); cy++)
+            for (uint32_t cx {first_cell(o.x)}; cx <= last_cell(o.x + o.width * 2); cx++)
+                cells[cy * grid_width + cx].push_back(i);
+    }
+    std::vector<uint32_t> cell_starts {0};
+    std::vector<uint32_t> cell_items;
+    for (const auto &cell : cells) {
+        cell_items.insert(cell_items.end(), cell.begin(), cell.end());
+        cell_starts.push_back(static_cast<uint32_t>(cell_items.size()));
+    }
+
+    CompiledMapHeader header {};
+    std::memcpy(header.magic, compiled_map_magic, sizeof(header.magic));
+    header.version = compiled_map_version;
+    header.content_hash = hash_obstacles(obstacles);
+    header.obstacle_count = count;
+    header.cell_size = compiled_map_cell_size;
+    header.grid_width = grid_width;
+    header.grid_height = grid_height;
+    header.grid_item_count = static_cast<uint32_t>(cell_items.size());
+
+    uint64_t offset {sizeof(CompiledMapHeader)};
+    header.xs_offset = offset;
+    offset += count * sizeof(uint16_t);
+    header.ys_offset = offset;
+    offset += count * sizeof(uint16_t);
+    header.widths_offset = offset;
+    offset += count * sizeof(uint16_t);
+    header.heights_offset = offset;
+    offset += count * sizeof(uint16_t);
+    header.colors_offset = offset;
+    offset += count * sizeof(Color);
+    header.cell_starts_offset = align_to(offset, alignof(uint32_t));
+    offset = header.cell_starts_offset + cell_starts.size() * sizeof(uint32_t);
+    header.cell_items_offset = offset;
+    offset += cell_items.size() * sizeof(uint32_t);
+    header.file_size = offset;
+
+    std::vector<uint8_t> result(offset, 0);
+    std::memcpy(result.data(), &header, sizeof(header));
+    write_array(result, header.xs_offset, xs);
+    write_array(result, header.ys_offset, ys);
+    write_array(result, header.widths_offset, widths);
+    write_array(result, header.heights_offset, heights);
+    write_array(result, header.colors_offset, colors);
+    write_array(result, header.cell_starts_offset, cell_starts);
+    write_array(result, header.cell_items_offset, cell_items);
+    return result;
+}
+
+bool write_compiled_map(const std::string &file_name, const std::vector<Obstacle> &obstacles) {
+    std::vector<uint8_t> data {compile_map(obstacles)};
+    std::ofstream file {file_name, std::ios::binary | std::ios::trunc};
+    if (!file.is_open()) {
+        std::cerr << "Could not open file for writing: " << file_name << std::endl;
+        return false;
+    }
+    file.write(reinterpret_cast<const char *>(data.data()), data.size());
+    return file.good();
+}
+
+CompiledMap::~CompiledMap() {
+    close();
+}
+
+CompiledMap::CompiledMap(CompiledMap &&other) noexcept {
+    *this = std::move(other);
+}
+
+CompiledMap &CompiledMap::operator=(CompiledMap &&other) noexcept {
+    if (this == &other)
+        return *this;
+    close();
+    data = other.data;
+    size = other.size;
+    header = other.header;
+    mapped = other.mapped;
+    owned = std::move(other.owned);
+    player_grid_width = other.player_grid_width;
+    player_grid_height = other.player_grid_height;
+    player_cell_starts = std::move(other.player_cell_starts);
+    player_cell_bounds = std::move(other.player_cell_bounds);
+    occupancy_bitmap = std::exchange(other.occupancy_bitmap, {});
+    other.data = nullptr;
+    other.size = 0;
+    other.header = nullptr;
+    other.mapped = false;
+    return *this;
+}
+
+void CompiledMap::close() {
+#ifndef _WIN32
+    if (mapped && data)
+        munmap(const_cast<uint8_t *>(data), size);
+#endif
+    data = nullptr;
+    size = 0;
+    header = nullptr;
+    mapped = false;
+    owned.clear();
+    player_grid_width = 0;
+    player_grid_height = 0;
+    player_cell_starts.clear();
+    player_cell_bounds.clear();
+    occupancy_bitmap = {};
+}
+
+bool CompiledMap::open(const std::string &file_name) {
+    close();
+#ifdef _WIN32
+    std::ifstream file {file_name, std::ios::binary};
+    if (!file.is_open()) {
+        std::cerr << "Could not open file: " << file_name << std::endl;
+        return false;
+    }
+    owned.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    data = owned.data();
+    size = owned.size();
+#else
+    int fd = ::open(file_name.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Could not open file: " << file_name << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(CompiledMapHeader))) {
+        std::cerr << "Compiled map is too small: " << file_name << std::endl;
+        ::close(fd);
+        return false;
+    }
+    void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        std::cerr << "Could not mmap file: " << file_name << std::endl;
+        return false;
+    }
+    data = static_cast<const uint8_t *>(addr);
+    size = st.st_size;
+    mapped = true;
+#endif
+    if (!validate()) {
+        std::cerr << "Invalid compiled map: " << file_name << std::endl;
+        close();
+        return false;
+    }
+    build_collision_data();
+    return true;
+}
+
+CompiledMap CompiledMap::from_obstacles(const std::vector<Obstacle> &obstacles) {
+    CompiledMap map;
+    map.owned = compile_map(obstacles);
+    map.data = map.owned.data();
+    map.size = map.owned.size();
+    if (map.validate())
+        map.build_collision_data();
+    return map;
+}
+
+void CompiledMap::build_collision_data() {
+    index_player_bounds();
+    occupancy_bitmap = OccupancyBitmap {obstacles()};
+}
+
+void CompiledMap::index_player_bounds() {
+    constexpr int player_width {player_size * 2};
+    // The corners of a player at (x, y) are (x, y) moved by 0 or player_width on each axis, so it touches an
+    // obstacle when (x, y) touches one of the 4 copies of the obstacle moved back by those offsets. Copies
+    // that overlap or are next to each other merge into one, only obstacles thinner than a player leave a gap
+    // between them (where the player straddles the obstacle without a corner touching it) and need both.
+    // The ranges are the inside of the obstacle, touching also counts 1 unit outside of it
+    auto ranges = [](int start, int end) {
+        std::vector<std::pair<int, int>> result;
+        if (end - start >= player_width - 1) {
+            result.emplace_back(start - player_width, end);
+        } else {
+            result.emplace_back(start - player_width, end - player_width);
+            result.emplace_back(start, end);
+        }
+        return result;
+    };
+
+    std::vector<PlayerBounds> bounds;
+    for (uint32_t i {0}; i < obstacle_count(); i++) {
+        // right and bottom wrap like they do in the corner test
+        uint16_t right = xs()[i] + widths()[i] * 2;
+        uint16_t bottom = ys()[i] + heights()[i] * 2;
+        for (auto [left, inner_right] : ranges(xs()[i], right)) {
+            for (auto [top, inner_bottom] : ranges(ys()[i], bottom)) {
+                // players never have negative coordinates
+                if (inner_right + 1 >= 0 && inner_bottom + 1 >= 0)
+                    bounds.push_back({left - 1, top - 1, inner_right + 1, inner_bottom + 1});
+            }
+        }
+    }
+
+    auto first_cell = [](int v) { return static_cast<uint32_t>(std::max(v, 0)) / compiled_map_cell_size; };
+    auto last_cell = [](int v) { return static_cast<uint32_t>(v) / compiled_map_cell_size; };
+    player_grid_width = 1;
+    player_grid_height = 1;
+    for (const auto &b : bounds) {
+        player_grid_width = std::max(player_grid_width, last_cell(b.right) + 1);
+        player_grid_height = std::max(player_grid_height, last_cell(b.bottom) + 1);
+    }
+    std::vector<std::vector<PlayerBounds>> cells(player_grid_width * player_grid_height);
+    for (const auto &b : bounds) {
+        for (uint32_t cy {first_cell(b.top)}; cy <= last_cell(b.bottom); cy++)
+            for (uint32_t cx {first_cell(b.left)}; cx <= last_cell(b.right); cx++)
+                cells[cy * player_grid_width + cx].push_back(b);
+    }
+    player_cell_starts.assign(1, 0);
+    player_cell_bounds.clear();
+    for (const auto &cell : cells) {
+        player_cell_bounds.insert(player_cell_bounds.end(), cell.begin(), cell.end());
+        player_cell_starts.push_back(static_cast<uint32_t>(player_cell_bounds.size()));
+    }
+}
+
+bool CompiledMap::validate() {
+    if (size < sizeof(CompiledMapHeader))
+        return false;
+    auto h = reinterpret_cast<const CompiledMapHeader *>(data);
+    if (std::memcmp(h->magic, compiled_map_magic, sizeof(h->magic)) != 0) {
+        std::cerr << "Compiled map has the wrong magic" << std::endl;
+        return false;
+    }
+    if (h->version != compiled_map_version) {
+        std::cerr << "Compiled map version " << h->version << " is not supported, expected " << compiled_map_version << std::endl;
+        return false;
+    }
+    uint64_t num_cells = static_cast<uint64_t>(h->grid_width) * h->grid_height;
+    auto fits = [&](uint64_t offset, uint64_t bytes) { return offset <= h->file_size && bytes <= h->file_size - offset; };
+    if (h->file_size != size || h->cell_size == 0 ||
+        !fits(h->xs_offset, h->obstacle_count * sizeof(uint16_t)) ||
+        !fits(h->ys_offset, h->obstacle_count * sizeof(uint16_t)) ||
+        !fits(h->widths_offset, h->obstacle_count * sizeof(uint16_t)) ||
+        !fits(h->heights_offset, h->obstacle_count * sizeof(uint16_t)) ||
+        !fits(h->colors_offset, h->obstacle_count * sizeof(Color)) ||
+        !fits(h->cell_starts_offset, (num_cells + 1) * sizeof(uint32_t)) ||
+        !fits(h->cell_items_offset, h->grid_item_count * static_cast<uint64_t>(sizeof(uint32_t))) ||
+        h->xs_offset % alignof(uint16_t) || h->cell_starts_offset % alignof(uint32_t) || h->cell_items_offset % alignof(uint32_t)) {
+        std::cerr << "Compiled map sections are out of bounds" << std::endl;
+        return false;
+    }
+    header = h;
+    const uint32_t *starts = array<uint32_t>(h->cell_starts_offset);
+    const uint32_t *items = array<uint32_t>(h->cell_items_offset);
+    bool index_ok = starts[num_cells] == h->grid_item_count &&
+        std::is_sorted(starts, starts + num_cells + 1) &&
+        std::all_of(items, items + h->grid_item_count, [h](uint32_t idx) { return idx < h->obstacle_count; });
+    if (!index_ok) {
+        std::cerr << "Compiled map spatial index is corrupt" << std::endl;
+        header = nullptr;
+        return false;
+    }
+    return true;
+}
+
+Obstacle CompiledMap::obstacle(uint32_t idx) const {
+    return {xs()[idx], ys()[idx], widths()[idx], heights()[idx], colors()[idx]};
+}
+
+std::vector<Obstacle> CompiledMap::obstacles() const {
+    std::vector<Obstacle> result;
+    result.reserve(obstacle_count());
+    for (uint32_t i {0}; i < obstacle_count(); i++)
+        result.push_back(obstacle(i));
+    return result;
+}
+
+std::pair<const uint32_t *, const uint32_t *> CompiledMap::obstacles_near(int x, int y) const {
+    if (!header || x < 0 || y < 0)
+        return {nullptr, nullptr};
+    uint32_t cx = static_cast<uint32_t>(x) / header->cell_size;
+    uint32_t cy = static_cast<uint32_t>(y) / header->cell_size;
+    if (cx >= header->grid_width || cy >= header->grid_height)
+        return {nullptr, nullptr};
+    const uint32_t *starts = array<uint32_t>(header->cell_starts_offset);
+    const uint32_t *items = array<uint32_t>(header->cell_items_offset);
+    uint32_t cell = cy * header->grid_width + cx;
+    return {items + starts[cell], items + starts[cell + 1]};
+}
+
+std::pair<const PlayerBounds *, const PlayerBounds *> CompiledMap::player_bounds_near(int x, int y) const {
+    if (player_cell_starts.empty() || x < 0 || y < 0)
+        return {nullptr, nullptr};
+    uint32_t cx = static_cast<uint32_t>(x) / compiled_map_cell_size;
+    uint32_t cy = static_cast<uint32_t>(y) / compiled_map_cell_size;
+    if (cx >= player_grid_width || cy >= player_grid_height)
+        return {nullptr, nullptr};
+    uint32_t cell = cy * player_grid_width + cx;
+    return {player_cell_bounds.data() + player_cell_starts[cell], player_cell_bounds.data() + player_cell_starts[cell + 1]};
+}
+
+CompiledMap load_map(const std::string &map_name) {
+    CompiledMap map;
+    if (map.open(map_name + ".lmap"))
+        return map;
+    std::cout << "No compiled map found for " << map_name << ", compiling " << map_name << ".txt" << std::endl;
+    return CompiledMap::from_obstacles(load_from_file(map_name + ".txt"));
+}
@@ -0,0 +1,135 @@
+#pragma once
+#ifndef COMPILED_MAP_H
+#define COMPILED_MAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Obstacle.h"
+#include "OccupancyBitmap.h"
+#include "Player.h"
+#include "utils.h"
+
+// Binary map format produced by Lastand-MapCompiler from the resources/maps/*.txt files.
+// Everything is stored in native (little endian) byte order so the server can use the
+// arrays straight out of the mmap'd file:
+//
+//   CompiledMapHeader
+//   uint16_t xs[obstacle_count], ys[...], widths[...], heights[...]
+//   Color    colors[obstacle_count]
+//   uint32_t cell_starts[grid_width * grid_height + 1]
+//   uint32_t cell_items[grid_item_count]   obstacle indices bucketed by grid cell
+constexpr char compiled_map_magic[4] {'L', 'M', 'A', 'P'};
+constexpr uint32_t compiled_map_version {1};
+
+// size of a spatial index cell, in server coordinates
+constexpr uint32_t compiled_map_cell_size {64};
+
+struct CompiledMapHeader {
+    char magic[4];
+    uint32_t version;
+    // hash of the serialized obstacles (see hash_obstacles()), the same on client and server
+    uint64_t content_hash;
+    uint64_t file_size;
+
+    uint32_t obstacle_count;
+    uint32_t cell_size;
+    uint32_t grid_width;
+    uint32_t grid_height;
+    uint32_t grid_item_count;
+    uint32_t reserved;
+
+    // byte offsets from the start of the file
+    uint64_t xs_offset;
+    uint64_t ys_offset;
+    uint64_t widths_offset;
+    uint64_t heights_offset;
+    uint64_t colors_offset;
+    uint64_t cell_starts_offset;
+    uint64_t cell_items_offset;
+};
+
+// An obstacle grown by the size of a player. A player whose top left corner is at (x, y) touches the obstacle
+// (see detect_collision()) exactly when (x, y) is within these bounds but isn't one of their 4 corners
+struct PlayerBounds {
+    int32_t left;
+    int32_t top;
+    int32_t right;
+    int32_t bottom;
+
+    bool contains(int x, int y) const {
+        return left <= x && x <= right && top <= y && y <= bottom &&
+            !((x == left || x == right) && (y == top || y == bottom));
+    }
+};
+
+// hash of the obstacles as they are sent over the network by serialize_obstacle()
+uint64_t hash_obstacles(const std::vector<Obstacle> &obstacles);
+
+std::vector<uint8_t> compile_map(const std::vector<Obstacle> &obstacles);
+bool write_compiled_map(const std::string &file_name, const std::vector<Obstacle> &obstacles);
+
+// A compiled map, either mmap'd from disk or built in memory from a list of obstacles.
+// All accessors point directly into the underlying buffer.
+class CompiledMap {
+public:
+    CompiledMap() = default;
+    ~CompiledMap();
+    CompiledMap(const CompiledMap &) = delete;
+    CompiledMap &operator=(const CompiledMap &) = delete;
+    CompiledMap(CompiledMap &&other) noexcept;
+    CompiledMap &operator=(CompiledMap &&other) noexcept;
+
+    // maps the file into memory, returns false if it can't be opened or isn't a valid map
+    bool open(const std::string &file_name);
+    static CompiledMap from_obstacles(const std::vector<Obstacle> &obstacles);
+
+    bool empty() const { return obstacle_count() == 0; }
+    uint32_t obstacle_count() const { return header ? header->obstacle_count : 0; }
+    uint64_t content_hash() const { return header ? header->content_hash : 0; }
+
+    const uint16_t *xs() const { return array<uint16_t>(header->xs_offset); }
+    const uint16_t *ys() const { return array<uint16_t>(header->ys_offset); }
+    const uint16_t *widths() const { return array<uint16_t>(header->widths_offset); }
+    const uint16_t *heights() const { return array<uint16_t>(header->heights_offset); }
+    const Color *colors() const { return array<Color>(header->colors_offset); }
+
+    Obstacle obstacle(uint32_t idx) const;
+    std::vector<Obstacle> obstacles() const;
+
+    // obstacle indices whose bounds (grown by 1 unit) touch the grid cell containing (x, y)
+    std::pair<const uint32_t *, const uint32_t *> obstacles_near(int x, int y) const;
+    // bounds of the obstacles a player whose top left corner is in the grid cell containing (x, y) might touch
+    std::pair<const PlayerBounds *, const PlayerBounds *> player_bounds_near(int x, int y) const;
+    // which points are inside an obstacle
+    const OccupancyBitmap &occupancy() const { return occupancy_bitmap; }
+
+private:
+    template <typename T>
+    const T *array(uint64_t offset) const { return reinterpret_cast<const T *>(data + offset); }
+    bool validate();
+    // builds the player bounds with their grid and the occupancy bitmap, they aren't stored in the file
+    void build_collision_data();
+    void index_player_bounds();
+    void close();
+
+    const uint8_t *data {nullptr};
+    size_t size {0};
+    const CompiledMapHeader *header {nullptr};
+    bool mapped {false};
+    std::vector<uint8_t> owned;
+
+    uint32_t player_grid_width {0};
+    uint32_t player_grid_height {0};
+    std::vector<uint32_t> player_cell_starts;
+    // bucketed by grid cell like cell_items, copies so a cell's bounds are next to each other
+    std::vector<PlayerBounds> player_cell_bounds;
+    OccupancyBitmap occupancy_bitmap;
+};
+
+// loads the compiled version of a map (made by Lastand-MapCompiler), falling back to the text version.
+// map_name is the path without the extension, e.g. maps/map2
+CompiledMap load_map(const std::string &map_name);
+
+#endif // COMPILED_MAP_H
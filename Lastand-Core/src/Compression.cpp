@@ -0,0 +1,289 @@
+#include "Compression.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+struct CompressionContext {
+    explicit CompressionContext(CompressionCodec codec): codec {codec} {}
+
+    CompressionCodec codec;
+    void *range_coder {nullptr};
+    CompressionStats stats {};
+    // ENet hands the datagram over in pieces, the LZ codec wants it in one buffer
+    std::vector<uint8_t> scratch;
+};
+
+uint64_t elapsed_ns(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// LZ: a sequence of tokens, the high nibble of a token is the number of literals that follow it and the
+// low nibble the length of the match after them minus 4. A nibble of 15 means the length continues in the
+// next bytes, each adding up to 255. The literals come next, then the match's 16-bit little endian offset
+// back into the output. The last token only has literals.
+constexpr size_t lz_min_match {4};
+// datagrams are at most a few KB, a small table is cheaper to clear for every one of them
+constexpr int lz_hash_bits {11};
+
+uint32_t read_uint32(const uint8_t *p) {
+    uint32_t val;
+    std::memcpy(&val, p, sizeof(val));
+    return val;
+}
+
+uint32_t lz_hash(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - lz_hash_bits);
+}
+
+// writes the extra bytes of a length whose nibble was 15
+bool lz_write_length(uint8_t *out, size_t &out_idx, size_t out_limit, size_t length) {
+    for (; length >= 255; length -= 255) {
+        if (out_idx >= out_limit)
+            return false;
+        out[out_idx++] = 255;
+    }
+    if (out_idx >= out_limit)
+        return false;
+    out[out_idx++] = static_cast<uint8_t>(length);
+    return true;
+}
+
+bool lz_read_length(const uint8_t *in, size_t &in_idx, size_t in_size, size_t &length) {
+    uint8_t byte;
+    do {
+        if (in_idx >= in_size)
+            return false;
+        byte = in[in_idx++];
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+bool lz_write_sequence(uint8_t *out, size_t &out_idx, size_t out_limit, const uint8_t *literals, size_t num_literals,
+                       size_t offset, size_t match_length) {
+    if (out_idx >= out_limit)
+        return false;
+    size_t token_idx {out_idx++};
+    uint8_t token = static_cast<uint8_t>(std::min<size_t>(num_literals, 15) << 4);
+    if (num_literals >= 15 && !lz_write_length(out, out_idx, out_limit, num_literals - 15))
+        return false;
+    if (num_literals > out_limit - out_idx)
+        return false;
+    if (num_literals > 0)
+        std::memcpy(out + out_idx, literals, num_literals);
+    out_idx += num_literals;
+
+    if (match_length > 0) {
+        size_t extra {match_length - lz_min_match};
+        token |= static_cast<uint8_t>(std::min<size_t>(extra, 15));
+        if (out_limit - out_idx < 2)
+            return false;
+        out[out_idx++] = static_cast<uint8_t>(offset);
+        out[out_idx++] = static_cast<uint8_t>(offset >> 8);
+        if (extra >= 15 && !lz_write_length(out, out_idx, out_limit, extra - 15))
+            return false;
+    }
+    out[token_idx] = token;
+    return true;
+}
+
+size_t ENET_CALLBACK compress(void *context, const ENetBuffer *in_buffers, size_t in_buffer_count, size_t in_limit,
+                              enet_uint8 *out_data, size_t out_limit) {
+    auto *c = static_cast<CompressionContext *>(context);
+    if (c->codec == CompressionCodec::None || out_limit < 2)
+        return 0;
+    auto start = std::chrono::steady_clock::now();
+
+    size_t compressed_size {0};
+    if (c->codec == CompressionCodec::RangeCoder) {
+        compressed_size = enet_range_coder_compress(c->range_coder, in_buffers, in_buffer_count, in_limit, out_data + 1, out_limit - 1);
+    } else {
+        c->scratch.resize(in_limit);
+        size_t in_size {0};
+        for (size_t i {0}; i < in_buffer_count && in_size < in_limit; i++) {
+            size_t length {std::min(in_buffers[i].dataLength, in_limit - in_size)};
+            std::memcpy(c->scratch.data() + in_size, in_buffers[i].data, length);
+            in_size += length;
+        }
+        compressed_size = lz_compress(c->scratch.data(), in_size, out_data + 1, out_limit - 1);
+    }
+
+    c->stats.compress_ns += elapsed_ns(start);
+    if (compressed_size == 0 || compressed_size + 1 >= in_limit) {
+        c->stats.packets_uncompressed++;
+        return 0; // ENet sends the datagram uncompressed
+    }
+    out_data[0] = static_cast<uint8_t>(c->codec);
+    c->stats.packets_compressed++;
+    c->stats.bytes_in += in_limit;
+    c->stats.bytes_out += compressed_size + 1;
+    return compressed_size + 1;
+}
+
+size_t ENET_CALLBACK decompress(void *context, const enet_uint8 *in_data, size_t in_limit, enet_uint8 *out_data, size_t out_limit) {
+    auto *c = static_cast<CompressionContext *>(context);
+    if (in_limit < 1)
+        return 0;
+    auto start = std::chrono::steady_clock::now();
+
+    size_t size {0};
+    switch (static_cast<CompressionCodec>(in_data[0])) {
+        case CompressionCodec::RangeCoder:
+            size = enet_range_coder_decompress(c->range_coder, in_data + 1, in_limit - 1, out_data, out_limit);
+            break;
+        case CompressionCodec::LZ:
+            size = lz_decompress(in_data + 1, in_limit - 1, out_data, out_limit);
+            break;
+        default:
+            break; // ENet drops the datagram
+    }
+
+    c->stats.decompress_ns += elapsed_ns(start);
+    c->stats.packets_decompressed++;
+    c->stats.bytes_received += in_limit;
+    c->stats.bytes_decompressed += size;
+    return size;
+}
+
+void ENET_CALLBACK destroy(void *context) {
+    auto *c = static_cast<CompressionContext *>(context);
+    if (c->range_coder)
+        enet_range_coder_destroy(c->range_coder);
+    delete c;
+}
+
+} // namespace
+
+size_t lz_compress(const uint8_t *in, size_t in_size, uint8_t *out, size_t out_limit) {
+    if (in_size >= UINT16_MAX)
+        return 0;
+    // positions + 1 of the last place each hashed 4 byte sequence was seen, 0 if it wasn't
+    uint16_t table[1 << lz_hash_bits] {};
+    size_t out_idx {0};
+    size_t anchor {0};
+    size_t i {0};
+
+    while (in_size >= lz_min_match && i <= in_size - lz_min_match) {
+        uint32_t sequence {read_uint32(in + i)};
+        uint16_t &entry {table[lz_hash(sequence)]};
+        size_t candidate {entry};
+        entry = static_cast<uint16_t>(i + 1);
+        if (candidate == 0 || read_uint32(in + candidate - 1) != sequence) {
+            i++;
+            continue;
+        }
+        candidate--;
+        size_t match_length {lz_min_match};
+        while (i + match_length < in_size && in[candidate + match_length] == in[i + match_length])
+            match_length++;
+        if (!lz_write_sequence(out, out_idx, out_limit, in + anchor, i - anchor, i - candidate, match_length))
+            return 0;
+        i += match_length;
+        anchor = i;
+    }
+    if (!lz_write_sequence(out, out_idx, out_limit, in + anchor, in_size - anchor, 0, 0))
+        return 0;
+    return out_idx;
+}
+
+size_t lz_decompress(const uint8_t *in, size_t in_size, uint8_t *out, size_t out_limit) {
+    size_t in_idx {0};
+    size_t out_idx {0};
+    while (in_idx < in_size) {
+        uint8_t token {in[in_idx++]};
+        size_t num_literals {static_cast<size_t>(token >> 4)};
+        if (num_literals == 15 && !lz_read_length(in, in_idx, in_size, num_literals))
+            return 0;
+        if (num_literals > in_size - in_idx || num_literals > out_limit - out_idx)
+            return 0;
+        std::memcpy(out + out_idx, in + in_idx, num_literals);
+        in_idx += num_literals;
+        out_idx += num_literals;
+        if (in_idx == in_size)
+            break; // the last token only has literals
+
+        if (in_size - in_idx < 2)
+            return 0;
+        size_t offset {static_cast<size_t>(in[in_idx]) | static_cast<size_t>(in[in_idx + 1]) << 8};
+        in_idx += 2;
+        size_t match_length {static_cast<size_t>(token & 0x0F)};
+        if (match_length == 15 && !lz_read_length(in, in_idx, in_size, match_length))
+            return 0;
+        match_length += lz_min_match;
+        if (offset == 0 || offset > out_idx || match_length > out_limit - out_idx)
+            return 0;
+        // byte by byte, the match can overlap the bytes it produces
+        for (size_t j {0}; j < match_length; j++, out_idx++)
+            out[out_idx] = out[out_idx - offset];
+    }
+    return out_idx;
+}
+
+uint32_t compression_connect_data(CompressionCodec codec) {
+    return supported_codecs_mask | static_cast<uint32_t>(codec) << 8;
+}
+
+bool compression_compatible(uint32_t connect_data, CompressionCodec codec) {
+    uint32_t client_codec {(connect_data >> 8) & 0xFF};
+    bool client_can_decompress = codec == CompressionCodec::None || (connect_data & (1u << static_cast<uint32_t>(codec)));
+    return client_can_decompress && (supported_codecs_mask & (1u << client_codec));
+}
+
+const char *compression_codec_name(CompressionCodec codec) {
+    switch (codec) {
+        case CompressionCodec::None:
+            return "none";
+        case CompressionCodec::RangeCoder:
+            return "range";
+        case CompressionCodec::LZ:
+            return "lz";
+    }
+    return "unknown";
+}
+
+bool parse_compression_codec(const std::string &name, CompressionCodec &codec) {
+    for (auto c : {CompressionCodec::None, CompressionCodec::RangeCoder, CompressionCodec::LZ}) {
+        if (name == compression_codec_name(c)) {
+            codec = c;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::ostream &operator<<(std::ostream &os, const CompressionStats &stats) {
+    uint64_t packets {stats.packets_compressed + stats.packets_uncompressed};
+    os << stats.packets_compressed << '/' << packets << " packets compressed, ratio " << stats.ratio()
+       << ", " << (packets ? stats.compress_ns / 1000.0 / packets : 0.0) << " us/packet compressing, "
+       << stats.packets_decompressed << " packets decompressed, ratio " << stats.received_ratio() << ", "
+       << (stats.packets_decompressed ? stats.decompress_ns / 1000.0 / stats.packets_decompressed : 0.0)
+       << " us/packet decompressing";
+    return os;
+}
+
+bool enable_compression(ENetHost *host, CompressionCodec codec) {
+    auto *c = new CompressionContext(codec);
+    c->range_coder = enet_range_coder_create();
+    if (!c->range_coder) {
+        delete c;
+        return false;
+    }
+    ENetCompressor compressor {c, compress, decompress, destroy};
+    enet_host_compress(host, &compressor);
+    return true;
+}
+
+CompressionCodec compression_codec(const ENetHost *host) {
+    if (host->compressor.compress != compress)
+        return CompressionCodec::None;
+    return static_cast<const CompressionContext *>(host->compressor.context)->codec;
+}
+
+const CompressionStats *compression_stats(const ENetHost *host) {
+    if (host->compressor.compress != compress)
+        return nullptr;
+    return &static_cast<const CompressionContext *>(host->compressor.context)->stats;
+}
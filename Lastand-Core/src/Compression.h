@@ -0,0 +1,70 @@
+#pragma once
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <enet/enet.h>
+
+// Compression of the UDP datagrams ENet sends, installed with enable_compression().
+//
+// Every compressed datagram starts with the CompressionCodec it was compressed with, so a host
+// can decompress datagrams from any peer no matter which codec it uses itself.
+enum class CompressionCodec: uint8_t {
+    None = 0,
+    // ENet's adaptive range coder, best ratio but the slowest
+    RangeCoder = 1,
+    // byte oriented LZ77 (in the same format as an LZ4 block), fast and good at the repeated
+    // headers and coordinates in our packets
+    LZ = 2
+};
+
+// the codecs this build can decompress, as bits of (1 << codec)
+constexpr uint32_t supported_codecs_mask {(1 << 0) | (1 << 1) | (1 << 2)};
+
+// reason given to enet_peer_disconnect() when a client can't decompress what the server sends
+constexpr uint32_t disconnect_unsupported_compression {1};
+
+// the data given to enet_host_connect(): the codecs the client can decompress in the low byte
+// and the codec it compresses with in the next byte
+uint32_t compression_connect_data(CompressionCodec codec);
+// whether a client that connected with data from compression_connect_data() can talk to a host compressing with codec
+bool compression_compatible(uint32_t connect_data, CompressionCodec codec);
+
+const char *compression_codec_name(CompressionCodec codec);
+// accepts the names from compression_codec_name(), returns false for anything else
+bool parse_compression_codec(const std::string &name, CompressionCodec &codec);
+
+struct CompressionStats {
+    uint64_t packets_compressed {0}; // datagrams that got smaller and were sent compressed
+    uint64_t packets_uncompressed {0}; // datagrams that didn't get smaller and were sent as is
+    uint64_t bytes_in {0}; // size of the compressed datagrams before compression
+    uint64_t bytes_out {0}; // and after
+    uint64_t compress_ns {0}; // time spent compressing, including datagrams sent as is
+    uint64_t packets_decompressed {0};
+    uint64_t bytes_received {0}; // size of the received compressed datagrams
+    uint64_t bytes_decompressed {0}; // and after decompressing them
+    uint64_t decompress_ns {0};
+
+    // compressed size / uncompressed size of the datagrams that were sent compressed
+    double ratio() const { return bytes_in ? static_cast<double>(bytes_out) / bytes_in : 1.0; }
+    // the same for the datagrams that were received compressed
+    double received_ratio() const { return bytes_decompressed ? static_cast<double>(bytes_received) / bytes_decompressed : 1.0; }
+};
+
+std::ostream &operator<<(std::ostream &os, const CompressionStats &stats);
+
+// installs the compressor on the host. Outgoing datagrams are compressed with codec (not at all for None),
+// incoming ones are decompressed with whichever codec they say they use. Returns false if it couldn't be set up
+bool enable_compression(ENetHost *host, CompressionCodec codec);
+// the codec the host compresses with, None if compression isn't enabled
+CompressionCodec compression_codec(const ENetHost *host);
+// nullptr if compression isn't enabled on the host
+const CompressionStats *compression_stats(const ENetHost *host);
+
+// the LZ codec on its own, both return 0 if the output doesn't fit in out_limit or the input is malformed
+size_t lz_compress(const uint8_t *in, size_t in_size, uint8_t *out, size_t out_limit);
+size_t lz_decompress(const uint8_t *in, size_t in_size, uint8_t *out, size_t out_limit);
+
+#endif // COMPRESSION_H
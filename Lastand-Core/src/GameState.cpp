@@ -0,0 +1,225 @@
+#include "GameState.h"
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include "physics.h"
+#include "Trace.h"
+#include "utils.h"
+
+const Player default_player {0, 0, {255, 255, 255, 255}, "Player", 0};
+
+bool parse_game_input(const uint8_t *data, size_t length, PlayerId player_id, GameInput &input) {
+    if (length < 1)
+        return false;
+    input = {};
+    input.player_id = player_id;
+    switch (static_cast<MessageToServerTypes>(data[0])) {
+        case MessageToServerTypes::ClientMove:
+            if (length < 3) {
+                std::cerr << "Client move is too short: " << length << std::endl;
+                return false;
+            }
+            input.type = GameInputType::Move;
+            input.movement_type = ClientMovementTypes {data[1]};
+            input.movement = ClientMovement {data[2]};
+            return true;
+        case MessageToServerTypes::Shoot: {
+            if (length != 13) {
+                std::cerr << "Shoot message has the wrong length: " << length << std::endl;
+                return false;
+            }
+            std::array<uint8_t, 12> projectile_data;
+            std::copy_n(data + 1, projectile_data.size(), projectile_data.begin());
+            input.type = GameInputType::Shoot;
+            input.projectile = deserialize_projectile(projectile_data);
+            return true;
+        }
+        case MessageToServerTypes::ReadyUp:
+            input.type = GameInputType::Ready;
+            return true;
+        case MessageToServerTypes::UnReady:
+            input.type = GameInputType::UnReady;
+            return true;
+        default:
+            return false;
+    }
+}
+
+const Player &GameState::add_player(PlayerId id) {
+    players_connected++;
+    Player p {default_player};
+    p.username += std::to_string(id);
+    p.id = id;
+    p.color = random_color();
+    player_states[id] = PlayerState {p, false, {0, 0}};
+    return player_states.at(id).p;
+}
+
+bool GameState::remove_player(PlayerId id) {
+    players_connected--;
+    return player_states.erase(id) > 0;
+}
+
+bool GameState::set_username(PlayerId id, const std::string &username) {
+    auto player = player_states.find(id);
+    if (player == player_states.end())
+        return false;
+    player->second.p.username = username;
+    return true;
+}
+
+bool GameState::set_color(PlayerId id, Color color) {
+    auto player = player_states.find(id);
+    if (player == player_states.end())
+        return false;
+    player->second.p.color = color;
+    return true;
+}
+
+void GameState::apply_input(const GameInput &input) {
+    auto player = player_states.find(input.player_id);
+    if (player == player_states.end())
+        return; // the player has been killed
+    PlayerState &state {player->second};
+    switch (input.type) {
+        case GameInputType::Move:
+            switch (input.movement_type) {
+                case ClientMovementTypes::Start:
+                    update_player_delta(input.movement, false, state.player_movement);
+                    break;
+                case ClientMovementTypes::Stop:
+                    update_player_delta(input.movement, true, state.player_movement);
+                    break;
+                default:
+                    std::cerr << "Client movement type not recognized: " << (int)input.movement_type << std::endl;
+            }
+            break;
+        case GameInputType::Shoot: {
+            if (!started)
+                break;
+            if (rules.max_projectiles_per_player > 0 &&
+                std::count_if(projectile_states.begin(), projectile_states.end(), [&](const ProjectileDouble &p) { return p.player_id == state.p.id; })
+                    >= rules.max_projectiles_per_player)
+                break;
+            ProjectileDouble pd {input.projectile, state.p.id};
+#ifdef DEBUG
+            std::cout << "Shooting projectile: " << pd.x << ", " << pd.y << ", " << input.projectile.dx << ", " << input.projectile.dy << '\n';
+#endif
+            projectile_states.push_back(pd);
+            break;
+        }
+        case GameInputType::Ready:
+            state.ready = true;
+            break;
+        case GameInputType::UnReady:
+            state.ready = false;
+            break;
+    }
+}
+
+bool GameState::should_start_game() const {
+    return std::all_of(player_states.begin(), player_states.end(), [](const std::pair<const int, PlayerState> &data) { return data.second.ready; })
+           && players_connected > 1;
+}
+
+std::vector<GameEvent> GameState::step(const std::vector<GameInput> &inputs) {
+    TRACE_SCOPE("step");
+    scratch.reset();
+    std::vector<GameEvent> events;
+    {
+        TRACE_SCOPE("apply inputs");
+        for (const auto &input : inputs)
+            apply_input(input);
+    }
+
+    if (!started && should_start_game()) {
+        started = true;
+        events.push_back({GameEventType::GameStarted, 0, 0});
+    }
+
+    move_players();
+    for (auto [killed, killer] : move_projectiles()) {
+        player_states.erase(killed);
+        events.push_back({GameEventType::PlayerKilled, killed, killer});
+    }
+    ticks++;
+
+    if (started && player_states.size() == 1 && !player_won) {
+        player_won = true;
+        events.push_back({GameEventType::PlayerWon, player_states.begin()->second.p.id, 0});
+    }
+    return events;
+}
+
+void GameState::move_players() {
+    TRACE_SCOPE("move players");
+    for (auto &[id, data] : player_states) {
+        if (data.player_movement == std::make_pair<short, short>(0, 0))
+            continue;
+        auto actual_movement = std::make_pair(data.player_movement.first, data.player_movement.second);
+        if ((data.p.x <= min_x && actual_movement.first == -1) ||
+            (data.p.x >= max_x && actual_movement.first == 1)) {
+            actual_movement.first = 0;
+        }
+        if ((data.p.y <= min_y && actual_movement.second == -1) ||
+            (data.p.y >= max_y && actual_movement.second == 1)) {
+            actual_movement.second = 0;
+        }
+        if (actual_movement == std::make_pair<short, short>(0, 0))
+            continue;
+        auto collision = detect_collision(data.p, data.player_movement, map);
+
+#ifdef DEBUG
+        std::cout << "Collision x: " << (collision.axis == CollisionAxis::Horizontal || collision.axis == CollisionAxis::Both)
+                  << ", Collision y: " << (collision.axis == CollisionAxis::Vertical || collision.axis == CollisionAxis::Both) << '\n';
+#endif
+
+        if (!(collision.allowed_directions & (ClientMovement::Left | ClientMovement::Right)))
+            actual_movement.first = 0;
+        if (!(collision.allowed_directions & (ClientMovement::Up | ClientMovement::Down)))
+            actual_movement.second = 0;
+        data.p.move(actual_movement);
+#ifdef DEBUG
+        if (actual_movement != std::make_pair<short, short>(0, 0))
+            std::cout << "Player moved to " << id << ": " << data.p.x << ", " << data.p.y << '\n';
+#endif
+    }
+}
+
+std::pmr::map<PlayerId, PlayerId> GameState::move_projectiles() {
+    TRACE_SCOPE("move projectiles");
+    std::pmr::map<PlayerId, PlayerId> dead_players {&scratch};
+    std::pmr::vector<uint16_t> projectiles_to_remove {&scratch};
+    projectiles_to_remove.reserve(projectile_states.size());
+    uint16_t idx = 0;
+    for (auto &p : projectile_states) {
+        p.move(4);
+        Player player_that_got_hit;
+        bool hit_player = std::any_of(
+            player_states.begin(), player_states.end(),
+            [p, &player_that_got_hit](const std::pair<const int, PlayerState> &data) {
+                if (point_in_rect(data.second.p.x, data.second.p.y, player_size * 2, player_size * 2, p.x, p.y) &&
+                    data.second.p.id != p.player_id)
+                {
+                    player_that_got_hit = data.second.p;
+                    return true;
+                }
+                return false;
+        });
+        double distance_travelled = std::sqrt(std::pow(p.x - p.start_x, 2) + std::pow(p.y - p.start_y, 2));
+        if (p.x > max_x || p.y > max_y + player_size || p.x < min_x || p.y < min_y || (hit_player) || distance_travelled >= rules.projectile_range ||
+            point_in_obstacle(p.x, p.y, map)
+        ) {
+            projectiles_to_remove.push_back(idx);
+            if (hit_player) {
+                // someone got hit and died
+                dead_players[player_that_got_hit.id] = p.player_id;
+            }
+        }
+        idx++;
+    }
+    // erased from the back so the indices of the remaining ones stay valid
+    for (auto idx = projectiles_to_remove.rbegin(); idx != projectiles_to_remove.rend(); idx++)
+        projectile_states.erase(projectile_states.begin() + *idx);
+    return dead_players;
+}
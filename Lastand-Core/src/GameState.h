@@ -0,0 +1,138 @@
+#pragma once
+#ifndef GAME_STATE_H
+#define GAME_STATE_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory_resource>
+#include <string>
+#include <utility>
+#include <vector>
+#include "CompiledMap.h"
+#include "Player.h"
+#include "Projectile.h"
+#include "TickArena.h"
+#include "constants.h"
+#include "serialize.h"
+
+// the maximum distance a projectile can travel in pixels
+constexpr uint16_t max_obstacle_distance_travelled {500};
+
+// the rules a server can tune, a replay has to be run with the same ones it was recorded with
+struct GameRules {
+    // how far a projectile travels before it disappears
+    uint16_t projectile_range {max_obstacle_distance_travelled};
+    // the most projectiles a player can have in the air at once, 0 for no limit
+    uint16_t max_projectiles_per_player {0};
+};
+
+struct PlayerState {
+    Player p;
+    bool ready = false;
+    std::pair<short, short> player_movement;
+};
+
+// used in the simulation to store projectiles with decimal coordinates
+struct ProjectileDouble {
+    double x;
+    double y;
+    double dx;
+    double dy;
+    PlayerId player_id;
+    uint16_t start_x;
+    uint16_t start_y;
+
+    ProjectileDouble(Projectile p, PlayerId player_id)
+        : x{static_cast<double>(p.x)}, y{static_cast<double>(p.y)},
+          dx{p.dx / std::sqrt(std::pow(p.dx, 2) + std::pow(p.dy, 2))},
+          dy{std::sqrt(1 - dx * dx) * (p.dy < 0 ? -1 : 1)},
+          player_id{player_id},
+          start_x{p.x}, start_y{p.y}
+    {}
+
+    void move(uint8_t times = 1) {
+        for (uint8_t i = 0; i < times; i++) {
+            x += dx;
+            y += dy;
+        }
+    }
+};
+
+enum class GameInputType: uint8_t {
+    Move,
+    Shoot,
+    Ready,
+    UnReady
+};
+
+// something a player did, applied at the start of the next step()
+struct GameInput {
+    GameInputType type;
+    PlayerId player_id;
+    ClientMovementTypes movement_type; // only for Move
+    ClientMovement movement; // only for Move
+    Projectile projectile; // only for Shoot
+};
+
+// turns a message sent by a player (including the message type) into an input,
+// returns false if the message isn't a valid input for the simulation
+bool parse_game_input(const uint8_t *data, size_t length, PlayerId player_id, GameInput &input);
+
+enum class GameEventType: uint8_t {
+    GameStarted,
+    PlayerKilled, // player_id was killed by other_player_id
+    PlayerWon
+};
+
+struct GameEvent {
+    GameEventType type;
+    PlayerId player_id;
+    PlayerId other_player_id;
+};
+
+// The rules of the game, without any networking or I/O so the server, the replay tool
+// and anything else that needs to simulate the game all run the same code.
+class GameState {
+public:
+    explicit GameState(const CompiledMap &map, const GameRules &rules = {}): map {map}, rules {rules} {}
+
+    // adds a player that just connected, its color comes from random_color()
+    const Player &add_player(PlayerId id);
+    // for when a player disconnects, returns false if the player wasn't alive
+    bool remove_player(PlayerId id);
+    bool set_username(PlayerId id, const std::string &username);
+    bool set_color(PlayerId id, Color color);
+
+    // applies the inputs received since the last step and advances the game by one tick
+    std::vector<GameEvent> step(const std::vector<GameInput> &inputs);
+
+    const std::map<int, PlayerState> &players() const { return player_states; }
+    const std::vector<ProjectileDouble> &projectiles() const { return projectile_states; }
+    bool game_started() const { return started; }
+    // number of steps that have run
+    uint32_t tick() const { return ticks; }
+
+private:
+    void apply_input(const GameInput &input);
+    // whether the game should start: everyone is ready and there is more than one player connected
+    bool should_start_game() const;
+    void move_players();
+    // returns the players that got killed mapped to their killer, the map is in scratch
+    std::pmr::map<PlayerId, PlayerId> move_projectiles();
+
+    const CompiledMap &map;
+    GameRules rules;
+    std::map<int, PlayerState> player_states;
+    std::vector<ProjectileDouble> projectile_states;
+    // includes players that were killed but are still connected
+    int players_connected {0};
+    bool started {false};
+    bool player_won {false};
+    uint32_t ticks {0};
+    // for the containers that only live during a step
+    TickArena scratch {16 * 1024};
+};
+
+#endif // GAME_STATE_H
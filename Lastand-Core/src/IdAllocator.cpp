@@ -0,0 +1,40 @@
+#include "IdAllocator.h"
+#include <algorithm>
+
+constexpr uint16_t max_generation {(1 << (16 - player_id_index_bits)) - 1};
+
+IdAllocator::IdAllocator(size_t max_slots): max_slots {std::min(max_slots, max_player_slots)} {}
+
+bool IdAllocator::allocate(PlayerId &id) {
+    uint16_t slot;
+    if (!free_slots.empty()) {
+        slot = free_slots.front();
+        free_slots.pop_front();
+    } else if (generations.size() < max_slots) {
+        slot = static_cast<uint16_t>(generations.size());
+        generations.push_back(0);
+        in_use.push_back(false);
+    } else {
+        return false;
+    }
+    in_use[slot] = true;
+    live++;
+    id = static_cast<PlayerId>((generations[slot] << player_id_index_bits) | slot);
+    return true;
+}
+
+bool IdAllocator::release(PlayerId id) {
+    if (!is_live(id))
+        return false;
+    uint16_t slot {player_id_index(id)};
+    in_use[slot] = false;
+    live--;
+    generations[slot] = generations[slot] == max_generation ? 0 : generations[slot] + 1;
+    free_slots.push_back(slot);
+    return true;
+}
+
+bool IdAllocator::is_live(PlayerId id) const {
+    uint16_t slot {player_id_index(id)};
+    return slot < generations.size() && in_use[slot] && generations[slot] == player_id_generation(id);
+}
@@ -0,0 +1,42 @@
+#pragma once
+#ifndef ID_ALLOCATOR_H
+#define ID_ALLOCATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include "Player.h"
+
+// A player id is a slot index in the low bits and the slot's generation in the high bits.
+// The generation goes up every time a slot is reused, so a message about a player that
+// has already left doesn't get applied to whoever took their slot.
+constexpr int player_id_index_bits {10};
+constexpr uint16_t player_id_index_mask {(1 << player_id_index_bits) - 1};
+// the most players that can be connected at once
+constexpr size_t max_player_slots {1 << player_id_index_bits};
+
+constexpr uint16_t player_id_index(PlayerId id) { return id & player_id_index_mask; }
+constexpr uint16_t player_id_generation(PlayerId id) { return id >> player_id_index_bits; }
+
+class IdAllocator {
+public:
+    explicit IdAllocator(size_t max_slots = max_player_slots);
+
+    // returns false if every slot is in use
+    bool allocate(PlayerId &id);
+    // returns false if the id isn't live (already released, or from an older generation)
+    bool release(PlayerId id);
+    bool is_live(PlayerId id) const;
+    size_t live_count() const { return live; }
+
+private:
+    size_t max_slots;
+    std::vector<uint16_t> generations;
+    std::vector<bool> in_use;
+    // released slots are reused oldest first, so ids take as long as possible to come back
+    std::deque<uint16_t> free_slots;
+    size_t live {0};
+};
+
+#endif // ID_ALLOCATOR_H
@@ -0,0 +1,260 @@
+#include "NetworkEmulator.h"
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+// how much longer than the others a reordered datagram is held, a couple of ticks so the next datagrams overtake it
+constexpr uint32_t reorder_hold_ms {20};
+
+namespace {
+struct HeldDatagram {
+    uint64_t release_ms;
+    // datagrams due at the same time are released in the order they were taken
+    uint64_t order;
+    ENetAddress address;
+    std::vector<uint8_t> data;
+};
+
+// orders the heap so the datagram released next is at the front
+bool released_after(const HeldDatagram &a, const HeldDatagram &b) {
+    return a.release_ms != b.release_ms ? a.release_ms > b.release_ms : a.order > b.order;
+}
+
+struct Link {
+    LinkConditions conditions;
+    std::vector<HeldDatagram> held;
+    NetworkEmulationStats::Direction *stats;
+};
+
+struct Emulator {
+    NetworkConditions conditions;
+    // splitmix64, separate from random_uint32() so emulating doesn't change a game's random numbers
+    uint64_t random_state;
+    uint64_t next_order {0};
+    NetworkEmulationStats stats;
+    Link in {conditions.in, {}, &stats.in};
+    Link out {conditions.out, {}, &stats.out};
+
+    Emulator(const NetworkConditions &conditions): conditions {conditions}, random_state {conditions.seed} {}
+};
+}
+
+static std::mutex emulators_mutex;
+static std::map<const ENetHost *, std::unique_ptr<Emulator>> emulators;
+
+static Emulator *find_emulator(const ENetHost *host) {
+    std::lock_guard<std::mutex> lock {emulators_mutex};
+    auto it = emulators.find(host);
+    return it != emulators.end() ? it->second.get() : nullptr;
+}
+
+static uint64_t now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint64_t next_random(Emulator &emulator) {
+    uint64_t z = (emulator.random_state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// true with the given chance from 0 to 1. A random number is drawn every time, so the choices for a datagram
+// don't depend on which conditions are set
+static bool chance(Emulator &emulator, double probability) {
+    return static_cast<double>(next_random(emulator) >> 11) / (1ULL << 53) < probability;
+}
+
+// decides what happens to a datagram and holds on to the copies that get through
+static void take(Emulator &emulator, Link &link, const ENetAddress &address, const uint8_t *data, size_t length) {
+    link.stats->datagrams++;
+    bool drop {chance(emulator, link.conditions.loss)};
+    bool duplicate {chance(emulator, link.conditions.duplicate)};
+    if (drop) {
+        link.stats->dropped++;
+        return;
+    }
+    if (duplicate)
+        link.stats->duplicated++;
+
+    uint64_t now {now_ms()};
+    for (int copy {0}; copy < (duplicate ? 2 : 1); copy++) {
+        uint64_t delay {link.conditions.delay_ms};
+        if (link.conditions.jitter_ms > 0)
+            delay += next_random(emulator) % (link.conditions.jitter_ms + 1);
+        if (chance(emulator, link.conditions.reorder)) {
+            delay += reorder_hold_ms;
+            link.stats->reordered++;
+        }
+        link.held.push_back({now + delay, emulator.next_order++, address, std::vector<uint8_t>(data, data + length)});
+        std::push_heap(link.held.begin(), link.held.end(), released_after);
+    }
+    link.stats->held = link.held.size();
+}
+
+static int ENET_CALLBACK intercept_received(ENetHost *host, ENetEvent *) {
+    Emulator *emulator {find_emulator(host)};
+    if (emulator == nullptr || !emulator->in.conditions.active())
+        return 0;
+    take(*emulator, emulator->in, host->receivedAddress, host->receivedData, host->receivedDataLength);
+    return 1;
+}
+
+static int ENET_CALLBACK intercept_sent(ENetHost *host, const ENetAddress *address, const ENetBuffer *buffers, size_t buffer_count) {
+    Emulator *emulator {find_emulator(host)};
+    if (emulator == nullptr || !emulator->out.conditions.active())
+        return 0;
+    uint8_t data[ENET_PROTOCOL_MAXIMUM_MTU];
+    size_t length {0};
+    for (size_t i {0}; i < buffer_count; i++) {
+        if (length + buffers[i].dataLength > sizeof(data))
+            return 0; // can't happen with ENet's MTU, sent as is if it does
+        std::copy_n(static_cast<const uint8_t *>(buffers[i].data), buffers[i].dataLength, data + length);
+        length += buffers[i].dataLength;
+    }
+    take(*emulator, emulator->out, *address, data, length);
+    return static_cast<int>(length);
+}
+
+std::ostream &operator<<(std::ostream &os, const NetworkConditions &conditions) {
+    auto print_link = [&](const char *name, const LinkConditions &link) {
+        os << name << ' ' << link.delay_ms << " ms +0-" << link.jitter_ms << " ms, " << link.loss * 100 << "% loss, "
+           << link.duplicate * 100 << "% duplicated, " << link.reorder * 100 << "% reordered";
+    };
+    print_link("in", conditions.in);
+    print_link("; out", conditions.out);
+    os << "; seed " << conditions.seed;
+    return os;
+}
+
+bool parse_network_conditions(const std::string &spec, NetworkConditions &conditions) {
+    std::istringstream pairs {spec};
+    std::string pair;
+    while (std::getline(pairs, pair, ',')) {
+        size_t equals {pair.find('=')};
+        if (equals == std::string::npos)
+            return false;
+        std::string key {pair.substr(0, equals)};
+        std::string value {pair.substr(equals + 1)};
+        std::vector<LinkConditions *> links {&conditions.in, &conditions.out};
+        if (key.rfind("in.", 0) == 0) {
+            links = {&conditions.in};
+            key.erase(0, 3);
+        } else if (key.rfind("out.", 0) == 0) {
+            links = {&conditions.out};
+            key.erase(0, 4);
+        }
+
+        double number;
+        std::istringstream value_stream {value};
+        if (!(value_stream >> number) || !value_stream.eof() || number < 0)
+            return false;
+        if (key == "seed") {
+            if (links.size() != 2)
+                return false;
+            conditions.seed = static_cast<uint64_t>(number);
+            continue;
+        }
+        for (LinkConditions *link : links) {
+            if (key == "delay")
+                link->delay_ms = static_cast<uint32_t>(number);
+            else if (key == "jitter")
+                link->jitter_ms = static_cast<uint32_t>(number);
+            else if (key == "loss" && number <= 100)
+                link->loss = number / 100;
+            else if (key == "duplicate" && number <= 100)
+                link->duplicate = number / 100;
+            else if (key == "reorder" && number <= 100)
+                link->reorder = number / 100;
+            else
+                return false;
+        }
+    }
+    return true;
+}
+
+std::ostream &operator<<(std::ostream &os, const NetworkEmulationStats &stats) {
+    auto print_direction = [&](const char *name, const NetworkEmulationStats::Direction &direction) {
+        os << name << ' ' << direction.datagrams << " datagrams, " << direction.dropped << " dropped, " << direction.duplicated
+           << " duplicated, " << direction.reordered << " reordered, " << direction.held << " held";
+    };
+    print_direction("in", stats.in);
+    print_direction("; out", stats.out);
+    return os;
+}
+
+bool enable_network_emulation(ENetHost *host, const NetworkConditions &conditions) {
+    {
+        std::lock_guard<std::mutex> lock {emulators_mutex};
+        if (!emulators.try_emplace(host, std::make_unique<Emulator>(conditions)).second)
+            return false;
+    }
+    host->intercept = intercept_received;
+    host->sendIntercept = intercept_sent;
+    return true;
+}
+
+void disable_network_emulation(ENetHost *host) {
+    host->intercept = nullptr;
+    host->sendIntercept = nullptr;
+    std::lock_guard<std::mutex> lock {emulators_mutex};
+    emulators.erase(host);
+}
+
+void update_network_emulation(ENetHost *host) {
+    Emulator *emulator {find_emulator(host)};
+    if (emulator == nullptr)
+        return;
+    uint64_t now {now_ms()};
+    for (Link *link : {&emulator->out, &emulator->in}) {
+        while (!link->held.empty() && link->held.front().release_ms <= now) {
+            std::pop_heap(link->held.begin(), link->held.end(), released_after);
+            HeldDatagram datagram {std::move(link->held.back())};
+            link->held.pop_back();
+            if (link == &emulator->out) {
+                ENetBuffer buffer {};
+                buffer.data = datagram.data.data();
+                buffer.dataLength = datagram.data.size();
+                enet_socket_send(host->socket, &datagram.address, &buffer, 1);
+            } else {
+                enet_host_receive(host, &datagram.address, datagram.data.data(), datagram.data.size());
+            }
+        }
+        link->stats->held = link->held.size();
+    }
+}
+
+uint32_t network_emulation_wait_ms(const ENetHost *host, uint32_t timeout_ms) {
+    Emulator *emulator {find_emulator(host)};
+    if (emulator == nullptr)
+        return timeout_ms;
+    uint64_t now {now_ms()};
+    for (const Link *link : {&emulator->out, &emulator->in}) {
+        if (!link->held.empty())
+            timeout_ms = static_cast<uint32_t>(std::min<uint64_t>(timeout_ms, link->held.front().release_ms > now ? link->held.front().release_ms - now : 0));
+    }
+    return timeout_ms;
+}
+
+int service_emulated_host(ENetHost *host, ENetEvent *event, uint32_t timeout_ms) {
+    if (find_emulator(host) == nullptr)
+        return enet_host_service(host, event, timeout_ms);
+    uint64_t start {now_ms()};
+    while (true) {
+        update_network_emulation(host);
+        uint64_t elapsed {now_ms() - start};
+        uint32_t remaining {elapsed < timeout_ms ? static_cast<uint32_t>(timeout_ms - elapsed) : 0};
+        int result {enet_host_service(host, event, network_emulation_wait_ms(host, remaining))};
+        if (result != 0 || remaining == 0)
+            return result;
+    }
+}
+
+const NetworkEmulationStats *network_emulation_stats(const ENetHost *host) {
+    Emulator *emulator {find_emulator(host)};
+    return emulator != nullptr ? &emulator->stats : nullptr;
+}
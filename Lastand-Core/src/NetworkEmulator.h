@@ -0,0 +1,77 @@
+#pragma once
+#ifndef NETWORK_EMULATOR_H
+#define NETWORK_EMULATOR_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <enet/enet.h>
+
+// Emulates a bad network between a host and its peers, installed with enable_network_emulation(). Every
+// datagram the host sends or receives can be dropped, duplicated, delayed (with jitter) and held back so the
+// ones after it overtake it, which shows how the game holds up on a lossy or laggy link without any tools
+// outside the game. The choices are made with a generator of its own seeded from the conditions, so the same
+// conditions and the same traffic make the same choices every run.
+//
+// Outgoing datagrams are taken with ENet's send intercept and sent from the host's socket when their delay is
+// over. Incoming ones are taken with the intercept callback and handed back to the host with enet_host_receive().
+// Held datagrams are only released by update_network_emulation() or service_emulated_host(), so a host that
+// emulates must be serviced with the latter or have the former called every time it is serviced.
+
+struct LinkConditions {
+    uint32_t delay_ms {0};
+    // every datagram waits an extra 0 to jitter_ms on top of delay_ms, so jitter reorders datagrams too
+    uint32_t jitter_ms {0};
+    // chances from 0 to 1 that a datagram is dropped, arrives twice, or is held back long enough for the
+    // datagrams sent right after it to arrive first
+    double loss {0.0};
+    double duplicate {0.0};
+    double reorder {0.0};
+
+    // false if datagrams go through untouched
+    bool active() const { return delay_ms > 0 || jitter_ms > 0 || loss > 0 || duplicate > 0 || reorder > 0; }
+};
+
+struct NetworkConditions {
+    // what the host receives and what it sends
+    LinkConditions in;
+    LinkConditions out;
+    uint64_t seed {1};
+};
+
+std::ostream &operator<<(std::ostream &os, const NetworkConditions &conditions);
+
+// parses comma separated key=value pairs, e.g. "delay=80,jitter=20,loss=2,out.duplicate=1,seed=7". The keys are
+// delay and jitter in ms, loss, duplicate and reorder in percent, and seed. A key applies to both directions
+// unless it starts with in. or out.; returns false for anything else
+bool parse_network_conditions(const std::string &spec, NetworkConditions &conditions);
+
+struct NetworkEmulationStats {
+    struct Direction {
+        uint64_t datagrams {0}; // that went through the emulator, including the ones dropped
+        uint64_t dropped {0};
+        uint64_t duplicated {0};
+        uint64_t reordered {0};
+        uint64_t held {0}; // waiting to be released right now
+    };
+    Direction in;
+    Direction out;
+};
+
+std::ostream &operator<<(std::ostream &os, const NetworkEmulationStats &stats);
+
+// starts emulating the conditions on the host, replacing its intercept callbacks. Returns false if
+// the host already emulates
+bool enable_network_emulation(ENetHost *host, const NetworkConditions &conditions);
+// stops emulating and drops the datagrams still held, call it before destroying a host that emulates
+void disable_network_emulation(ENetHost *host);
+// sends and hands to the host the held datagrams whose time has come. Does nothing if the host doesn't emulate
+void update_network_emulation(ENetHost *host);
+// timeout_ms, or less if a held datagram is due to be released before then
+uint32_t network_emulation_wait_ms(const ENetHost *host, uint32_t timeout_ms);
+// enet_host_service() that releases held datagrams on time while it waits, just enet_host_service() for a host that doesn't emulate
+int service_emulated_host(ENetHost *host, ENetEvent *event, uint32_t timeout_ms);
+// nullptr if the host doesn't emulate. Only read them on the thread servicing the host
+const NetworkEmulationStats *network_emulation_stats(const ENetHost *host);
+
+#endif // NETWORK_EMULATOR_H
@@ -0,0 +1,77 @@
+#include "OccupancyBitmap.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+OccupancyBitmap::OccupancyBitmap(const std::vector<Obstacle> &obstacles) {
+    words.assign(row_words * height, 0);
+
+    for (const auto &o : obstacles) {
+        // the parts of obstacles outside of the world are never looked at
+        int left {o.x}, right {std::min(o.x + o.width * 2, width - 1)};
+        int bottom {std::min(o.y + o.height * 2, height - 1)};
+        for (int y {o.y}; y <= bottom; y++) {
+            uint64_t *row {words.data() + static_cast<size_t>(y) * row_words};
+            // whole words at a time, with the ends of the span masked
+            for (int x {left}; x <= right;) {
+                int bit {x % 64};
+                int count {std::min(64 - bit, right - x + 1)};
+                uint64_t mask {count == 64 ? ~uint64_t {0} : ((uint64_t {1} << count) - 1) << bit};
+                row[x / 64] |= mask;
+                x += count;
+            }
+        }
+    }
+}
+
+bool OccupancyBitmap::raycast(double x0, double y0, double x1, double y1, RaycastHit &hit) const {
+    if (words.empty())
+        return false;
+    double dx {x1 - x0};
+    double dy {y1 - y0};
+
+    // the part of the segment inside the bitmap, as fractions of it (Liang-Barsky), nothing outside is solid
+    double t_enter {0}, t_exit {1};
+    auto clip = [&](double p, double q) {
+        if (p == 0)
+            return q >= 0;
+        double t {q / p};
+        if (p < 0)
+            t_enter = std::max(t_enter, t);
+        else
+            t_exit = std::min(t_exit, t);
+        return t_enter <= t_exit;
+    };
+    if (!clip(-dx, x0) || !clip(dx, width - x0) || !clip(-dy, y0) || !clip(dy, height - y0))
+        return false;
+
+    constexpr double never {std::numeric_limits<double>::infinity()};
+    int cx {static_cast<int>(std::floor(x0 + dx * t_enter))};
+    int cy {static_cast<int>(std::floor(y0 + dy * t_enter))};
+    int step_x {dx > 0 ? 1 : -1};
+    int step_y {dy > 0 ? 1 : -1};
+    // how much of the segment it takes to cross one unit, and where it reaches the next unit boundary, on each axis
+    double delta_x {dx != 0 ? std::abs(1 / dx) : never};
+    double delta_y {dy != 0 ? std::abs(1 / dy) : never};
+    double next_x {dx > 0 ? (cx + 1 - x0) / dx : dx < 0 ? (cx - x0) / dx : never};
+    double next_y {dy > 0 ? (cy + 1 - y0) / dy : dy < 0 ? (cy - y0) / dy : never};
+
+    double t {t_enter};
+    while (true) {
+        if (is_solid(cx, cy)) {
+            hit = {cx, cy, t * std::hypot(dx, dy)};
+            return true;
+        }
+        if (std::min(next_x, next_y) > t_exit)
+            return false;
+        if (next_x < next_y) {
+            t = next_x;
+            next_x += delta_x;
+            cx += step_x;
+        } else {
+            t = next_y;
+            next_y += delta_y;
+            cy += step_y;
+        }
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+#ifndef OCCUPANCY_BITMAP_H
+#define OCCUPANCY_BITMAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Obstacle.h"
+#include "Player.h"
+
+// where a ray first hit something solid, see OccupancyBitmap::raycast()
+struct RaycastHit {
+    // the solid unit
+    int x;
+    int y;
+    // how far from the start of the ray it entered that unit
+    double distance;
+};
+
+// One bit for every unit of the world, set where a point is inside an obstacle (edges included, like
+// point_in_rect()). Built once when the map is loaded, so testing a point costs the same however many
+// obstacles there are. It covers everywhere a projectile can be before it is removed, about 175 KB
+// whatever the map. Everything outside of it, and all of a default constructed one, is empty.
+class OccupancyBitmap {
+public:
+    OccupancyBitmap() = default;
+    explicit OccupancyBitmap(const std::vector<Obstacle> &obstacles);
+
+    bool is_solid(int x, int y) const {
+        if (x < 0 || y < 0 || x >= width || y >= height || words.empty())
+            return false;
+        size_t bit {static_cast<size_t>(y) * row_words * 64 + static_cast<size_t>(x)};
+        return (words[bit / 64] >> (bit % 64)) & 1;
+    }
+
+    // walks the units the segment from (x0, y0) to (x1, y1) crosses (a DDA walk), clipped to the bitmap,
+    // and returns whether one is solid, with the first one in hit
+    bool raycast(double x0, double y0, double x1, double y1, RaycastHit &hit) const;
+
+    size_t size_bytes() const { return words.size() * sizeof(uint64_t); }
+
+    // projectiles are removed once they go past max_x, or player_size past max_y
+    static constexpr int width {max_x + 1};
+    static constexpr int height {max_y + player_size + 1};
+
+private:
+    static constexpr size_t row_words {(width + 63) / 64};
+    std::vector<uint64_t> words;
+};
+
+#endif // OCCUPANCY_BITMAP_H
@@ -0,0 +1,140 @@
+#include "PacketPool.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <enet/enet.h>
+
+// blocks of each class set aside per expected peer: the packet structs and commands of the packets in
+// flight, and their data, which is mostly small messages and bundles of up to bundle_max_size
+constexpr std::array<size_t, packet_pool_block_sizes.size()> blocks_per_peer {32, 48, 8, 8, 4, 4};
+// a class that runs out grows by a slab of this many blocks
+constexpr size_t blocks_per_slab {64};
+
+// every block starts with the index of its class, so free() knows where it goes back to. It keeps
+// what's after it aligned like malloc's memory
+constexpr size_t header_size {alignof(std::max_align_t)};
+constexpr uint32_t large_allocation {UINT32_MAX};
+
+namespace {
+struct FreeBlock {
+    FreeBlock *next;
+};
+
+struct SizeClass {
+    std::mutex mutex;
+    FreeBlock *free_blocks {nullptr};
+    std::atomic<uint64_t> allocations {0};
+    std::atomic<uint64_t> in_use {0};
+    std::atomic<uint64_t> peak_in_use {0};
+    std::atomic<uint64_t> blocks {0};
+};
+}
+
+static std::array<SizeClass, packet_pool_block_sizes.size()> size_classes;
+static std::atomic<uint64_t> large_allocations {0};
+static std::atomic<uint64_t> slab_bytes {0};
+
+static size_t stride(size_t class_index) {
+    return header_size + packet_pool_block_sizes[class_index];
+}
+
+// adds count blocks to the free list of the class, the class' mutex must be held
+static bool grow(size_t class_index, size_t count) {
+    SizeClass &c {size_classes[class_index]};
+    auto *slab = static_cast<std::byte *>(std::malloc(count * stride(class_index)));
+    if (slab == nullptr)
+        return false;
+    // pushed in reverse so the blocks are handed out in address order
+    for (size_t i {count}; i-- > 0;) {
+        std::byte *block {slab + i * stride(class_index)};
+        *reinterpret_cast<uint32_t *>(block) = static_cast<uint32_t>(class_index);
+        auto *free_block = reinterpret_cast<FreeBlock *>(block + header_size);
+        free_block->next = c.free_blocks;
+        c.free_blocks = free_block;
+    }
+    c.blocks.fetch_add(count, std::memory_order_relaxed);
+    slab_bytes.fetch_add(count * stride(class_index), std::memory_order_relaxed);
+    return true;
+}
+
+static void *ENET_CALLBACK pool_malloc(size_t size) {
+    auto it = std::lower_bound(packet_pool_block_sizes.begin(), packet_pool_block_sizes.end(), size);
+    if (it == packet_pool_block_sizes.end()) {
+        auto *block = static_cast<std::byte *>(std::malloc(header_size + size));
+        if (block == nullptr)
+            return nullptr;
+        *reinterpret_cast<uint32_t *>(block) = large_allocation;
+        large_allocations.fetch_add(1, std::memory_order_relaxed);
+        return block + header_size;
+    }
+
+    size_t class_index {static_cast<size_t>(it - packet_pool_block_sizes.begin())};
+    SizeClass &c {size_classes[class_index]};
+    FreeBlock *block;
+    {
+        std::lock_guard<std::mutex> lock {c.mutex};
+        if (c.free_blocks == nullptr && !grow(class_index, blocks_per_slab))
+            return nullptr;
+        block = c.free_blocks;
+        c.free_blocks = block->next;
+    }
+    c.allocations.fetch_add(1, std::memory_order_relaxed);
+    uint64_t in_use {c.in_use.fetch_add(1, std::memory_order_relaxed) + 1};
+    if (in_use > c.peak_in_use.load(std::memory_order_relaxed))
+        c.peak_in_use.store(in_use, std::memory_order_relaxed);
+    return block;
+}
+
+static void ENET_CALLBACK pool_free(void *memory) {
+    if (memory == nullptr)
+        return;
+    std::byte *block {static_cast<std::byte *>(memory) - header_size};
+    uint32_t class_index {*reinterpret_cast<uint32_t *>(block)};
+    if (class_index == large_allocation) {
+        std::free(block);
+        return;
+    }
+
+    SizeClass &c {size_classes[class_index]};
+    auto *free_block = static_cast<FreeBlock *>(memory);
+    {
+        std::lock_guard<std::mutex> lock {c.mutex};
+        free_block->next = c.free_blocks;
+        c.free_blocks = free_block;
+    }
+    c.in_use.fetch_sub(1, std::memory_order_relaxed);
+}
+
+int initialize_enet_with_pools(size_t expected_peers) {
+    for (size_t i {0}; i < size_classes.size(); i++) {
+        std::lock_guard<std::mutex> lock {size_classes[i].mutex};
+        size_t count {std::max(blocks_per_peer[i] * expected_peers, blocks_per_slab)};
+        if (!grow(i, count))
+            return -1;
+    }
+    ENetCallbacks callbacks {pool_malloc, pool_free, nullptr};
+    return enet_initialize_with_callbacks(ENET_VERSION, &callbacks);
+}
+
+PacketPoolStats packet_pool_stats() {
+    PacketPoolStats stats;
+    for (size_t i {0}; i < size_classes.size(); i++) {
+        const SizeClass &c {size_classes[i]};
+        stats.classes[i] = {packet_pool_block_sizes[i], c.allocations.load(std::memory_order_relaxed),
+                            c.in_use.load(std::memory_order_relaxed), c.peak_in_use.load(std::memory_order_relaxed),
+                            c.blocks.load(std::memory_order_relaxed)};
+    }
+    stats.large_allocations = large_allocations.load(std::memory_order_relaxed);
+    stats.slab_bytes = slab_bytes.load(std::memory_order_relaxed);
+    return stats;
+}
+
+std::ostream &operator<<(std::ostream &os, const PacketPoolStats &stats) {
+    for (const auto &c : stats.classes) {
+        os << c.block_size << " B: " << c.in_use << '/' << c.blocks << " in use (peak " << c.peak_in_use << "), "
+           << c.allocations << " allocations; ";
+    }
+    os << stats.large_allocations << " too big for the pools, " << stats.slab_bytes / 1024 << " KiB of slabs";
+    return os;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#ifndef PACKET_POOL_H
+#define PACKET_POOL_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+// Size class pools for everything ENet allocates, installed with initialize_enet_with_pools() instead of
+// enet_initialize(). ENet mallocs and frees a packet, its data and a command for every message sent or
+// received, which at the tick rate and with many peers is a lot of churn for malloc. Here they come from
+// free lists of fixed size blocks carved out of big slabs, and the block freed last is handed out first
+// while it is still in the cache.
+//
+// Slabs are never given back. Allocations bigger than the biggest class (the peers of a host, big
+// fragmented packets) still go to malloc.
+constexpr std::array<size_t, 6> packet_pool_block_sizes {64, 128, 256, 512, 1024, 2048};
+
+struct PacketPoolStats {
+    struct SizeClass {
+        size_t block_size {0};
+        uint64_t allocations {0}; // since the pools were set up
+        uint64_t in_use {0};
+        uint64_t peak_in_use {0};
+        uint64_t blocks {0}; // in use or free
+    };
+    std::array<SizeClass, packet_pool_block_sizes.size()> classes;
+    // too big for any class, given to malloc
+    uint64_t large_allocations {0};
+    uint64_t slab_bytes {0};
+};
+
+std::ostream &operator<<(std::ostream &os, const PacketPoolStats &stats);
+
+// sets up the pools with enough blocks for about expected_peers connected peers and initializes ENet
+// to use them. Returns enet_initialize_with_callbacks()'s result, 0 on success. Pools are thread safe
+int initialize_enet_with_pools(size_t expected_peers);
+// can be called from any thread
+PacketPoolStats packet_pool_stats();
+
+#endif // PACKET_POOL_H
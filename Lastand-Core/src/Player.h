@@ -1,23 +1,35 @@
 #pragma once
 #include <cstdint>
+#include "constants.h"
 #include "utils.h"
 #include <string>
 
 constexpr uint8_t player_size {20};
 
+// the most top left the player can go
+constexpr uint16_t min_x {0};
+constexpr uint16_t min_y {0};
+
+// the most bottom right the player can go
+constexpr uint16_t max_x {(window_size - player_size) * 2};
+constexpr uint16_t max_y {(window_size - player_size) * 2};
+
+// see IdAllocator for how ids are handed out
+using PlayerId = uint16_t;
+
 struct Player {
     uint16_t x;
     uint16_t y;
 
-    uint8_t id;
+    PlayerId id;
 
     Color color;
     std::string username;
 public:
-    Player(uint16_t x, uint16_t y, Color color, const std::string &username, uint8_t id): 
+    Player(uint16_t x, uint16_t y, Color color, const std::string &username, PlayerId id): 
         x {x}, y {y}, id {id}, color {color}, username {username} {};
     Player(): Player {0, 0, Color {}, "Player", 0} {};
-    Player(uint8_t id): Player {0, 0, {}, "Player", id} {};
+    Player(PlayerId id): Player {0, 0, {}, "Player", id} {};
     void move(std::pair<short, short> delta);
 };
 
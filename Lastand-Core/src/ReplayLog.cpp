@@ -0,0 +1,117 @@
+#include "ReplayLog.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <iostream>
+#include "serialize.h"
+
+static void write_uint32(std::ofstream &file, uint32_t val) {
+    auto data = serialize_int32(static_cast<int32_t>(val));
+    file.write(reinterpret_cast<const char *>(data.data()), data.size());
+}
+
+static void write_uint64(std::ofstream &file, uint64_t val) {
+    write_uint32(file, static_cast<uint32_t>(val >> 32));
+    write_uint32(file, static_cast<uint32_t>(val & 0xFFFFFFFF));
+}
+
+static bool read_uint32(std::ifstream &file, uint32_t &val) {
+    std::array<uint8_t, 4> data;
+    if (!file.read(reinterpret_cast<char *>(data.data()), data.size()))
+        return false;
+    val = static_cast<uint32_t>(deserialize_int32(data));
+    return true;
+}
+
+static bool read_uint64(std::ifstream &file, uint64_t &val) {
+    uint32_t high, low;
+    if (!read_uint32(file, high) || !read_uint32(file, low))
+        return false;
+    val = (static_cast<uint64_t>(high) << 32) | low;
+    return true;
+}
+
+bool ReplayWriter::open(const std::string &file_name, uint64_t map_hash, uint64_t seed, const GameRules &rules, uint32_t ticks_per_second) {
+    this->ticks_per_second = std::max(ticks_per_second, uint32_t {1});
+    file.open(file_name, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Could not open replay file: " << file_name << std::endl;
+        return false;
+    }
+    file.write(replay_magic, sizeof(replay_magic));
+    write_uint32(file, replay_version);
+    write_uint64(file, map_hash);
+    write_uint64(file, seed);
+    for (uint16_t rule : {rules.projectile_range, rules.max_projectiles_per_player}) {
+        auto [high_byte, low_byte] = serialize_uint16(rule);
+        const uint8_t data[2] {high_byte, low_byte};
+        file.write(reinterpret_cast<const char *>(data), sizeof(data));
+    }
+    file.flush();
+    return true;
+}
+
+void ReplayWriter::write(const ReplayEvent &event) {
+    if (!file.is_open())
+        return;
+    if (event.data.size() > UINT16_MAX) {
+        std::cerr << "Replay event is too big to record: " << event.data.size() << std::endl;
+        return;
+    }
+    write_uint32(file, event.tick);
+    auto [id_high_byte, id_low_byte] = serialize_uint16(event.player_id);
+    auto [high_byte, low_byte] = serialize_uint16(static_cast<uint16_t>(event.data.size()));
+    const uint8_t record_header[6] {static_cast<uint8_t>(event.type), id_high_byte, id_low_byte, event.channel, high_byte, low_byte};
+    file.write(reinterpret_cast<const char *>(record_header), sizeof(record_header));
+    file.write(reinterpret_cast<const char *>(event.data.data()), event.data.size());
+}
+
+void ReplayWriter::end_tick(uint32_t tick) {
+    if (!file.is_open() || tick % ticks_per_second != 0)
+        return;
+    write({tick, ReplayEventType::Tick, 0, 0, {}});
+    file.flush();
+}
+
+bool ReplayReader::open(const std::string &file_name) {
+    file.open(file_name, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Could not open replay file: " << file_name << std::endl;
+        return false;
+    }
+    char magic[4];
+    uint32_t version {0};
+    if (!file.read(magic, sizeof(magic)) || std::memcmp(magic, replay_magic, sizeof(magic)) != 0) {
+        std::cerr << file_name << " is not a replay file" << std::endl;
+        return false;
+    }
+    if (!read_uint32(file, version) || version < 2 || version > replay_version) {
+        std::cerr << "Replay version " << version << " is not supported, expected 2 to " << replay_version << std::endl;
+        return false;
+    }
+    if (!read_uint64(file, map_hash) || !read_uint64(file, seed))
+        return false;
+    if (version >= 3) {
+        uint8_t data[4];
+        if (!file.read(reinterpret_cast<char *>(data), sizeof(data)))
+            return false;
+        rules.projectile_range = deserialize_uint16(data[0], data[1]);
+        rules.max_projectiles_per_player = deserialize_uint16(data[2], data[3]);
+    }
+    return true;
+}
+
+bool ReplayReader::next(ReplayEvent &event) {
+    uint8_t record_header[6];
+    if (!read_uint32(file, event.tick) || !file.read(reinterpret_cast<char *>(record_header), sizeof(record_header)))
+        return false;
+    event.type = static_cast<ReplayEventType>(record_header[0]);
+    event.player_id = deserialize_uint16(record_header[1], record_header[2]);
+    event.channel = record_header[3];
+    event.data.resize(deserialize_uint16(record_header[4], record_header[5]));
+    if (!file.read(reinterpret_cast<char *>(event.data.data()), event.data.size())) {
+        std::cerr << "Replay ends in the middle of an event" << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#ifndef REPLAY_LOG_H
+#define REPLAY_LOG_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "GameState.h"
+#include "Player.h"
+
+// Append-only log of everything that changes the simulation on the server, replayed by Lastand-Replay.
+//
+// The file starts with the magic, the version, the map hash, the seed given to seed_random() and
+// the GameRules (projectile range and projectiles per player as uint16s, since version 3),
+// followed by records of: uint32 tick, uint8 event type, uint16 player id, uint8 channel,
+// uint16 data length and the data. Numbers are encoded with serialize_int32() and serialize_uint16().
+constexpr char replay_magic[4] {'L', 'R', 'P', 'L'};
+constexpr uint32_t replay_version {3};
+
+enum class ReplayEventType: uint8_t {
+    Connect = 0,
+    Disconnect = 1,
+    Input = 2, // a message from the player that was accepted by the server, data is the whole message
+    Tick = 3 // written every second so a replay runs up to the last tick, even without new inputs
+};
+
+struct ReplayEvent {
+    // number of game ticks that ran before the event happened
+    uint32_t tick;
+    ReplayEventType type;
+    PlayerId player_id;
+    uint8_t channel;
+    std::vector<uint8_t> data;
+};
+
+class ReplayWriter {
+public:
+    // ticks_per_second is how often the server ticks, for end_tick()
+    bool open(const std::string &file_name, uint64_t map_hash, uint64_t seed, const GameRules &rules, uint32_t ticks_per_second);
+    bool is_open() const { return file.is_open(); }
+    void write(const ReplayEvent &event);
+    // writes a Tick event and flushes the log every second of game time, so not much is lost if the server dies
+    void end_tick(uint32_t tick);
+
+private:
+    std::ofstream file;
+    uint32_t ticks_per_second {1};
+};
+
+class ReplayReader {
+public:
+    bool open(const std::string &file_name);
+    // reads the next event, returns false at the end of the log
+    bool next(ReplayEvent &event);
+
+    uint64_t map_hash {0};
+    uint64_t seed {0};
+    // the default rules for replays from before they were recorded
+    GameRules rules;
+
+private:
+    std::ifstream file;
+};
+
+#endif // REPLAY_LOG_H
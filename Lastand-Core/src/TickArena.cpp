@@ -0,0 +1,50 @@
+#include "TickArena.h"
+#include <iostream>
+
+TickArena::TickArena(size_t initial_size): block(initial_size) {}
+
+TickArena::~TickArena() {
+    reset();
+}
+
+void TickArena::reset() {
+    for (const auto &overflow : overflows)
+        std::pmr::new_delete_resource()->deallocate(overflow.p, overflow.bytes, overflow.alignment);
+    if (!overflows.empty()) {
+        size_t needed {used + overflow_bytes};
+        size_t new_size {block.size() ? block.size() : 1024};
+        while (new_size < needed)
+            new_size *= 2;
+#ifdef DEBUG
+        std::cout << "Tick arena grown from " << block.size() << " to " << new_size << " bytes" << std::endl;
+#endif
+        block = std::vector<std::byte>(new_size);
+        overflows.clear();
+    }
+    used = 0;
+    overflow_bytes = 0;
+}
+
+void *TickArena::do_allocate(size_t bytes, size_t alignment) {
+    uintptr_t base {reinterpret_cast<uintptr_t>(block.data())};
+    uintptr_t aligned {(base + used + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1)};
+    size_t end {aligned - base + bytes};
+    if (end <= block.size()) {
+        used = end;
+        return reinterpret_cast<void *>(aligned);
+    }
+    // a big tick, the next reset() makes room for it
+    void *p {std::pmr::new_delete_resource()->allocate(bytes, alignment)};
+    overflows.push_back({p, bytes, alignment});
+    overflow_bytes += bytes;
+    total_overflows++;
+    return p;
+}
+
+void TickArena::do_deallocate(void *, size_t, size_t) {
+    // everything is freed at once by reset()
+}
+
+bool TickArena::do_is_equal(const std::pmr::memory_resource &other) const noexcept {
+    return this == &other;
+}
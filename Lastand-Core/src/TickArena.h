@@ -0,0 +1,49 @@
+#pragma once
+#ifndef TICK_ARENA_H
+#define TICK_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+// Memory for the containers that only live during a tick, given out by bumping a pointer through one
+// block and all freed at once by reset(). Use it through std::pmr containers.
+//
+// What doesn't fit in the block comes from the heap, and the block is grown at the next reset() to hold
+// everything the biggest tick so far needed, so a steady state of ticks never touches the heap.
+// Containers using the arena must be gone (or moved away from it) before reset().
+class TickArena: public std::pmr::memory_resource {
+public:
+    explicit TickArena(size_t initial_size);
+    ~TickArena() override;
+    TickArena(const TickArena &) = delete;
+    TickArena &operator=(const TickArena &) = delete;
+
+    void reset();
+
+    // bytes given out since the last reset
+    size_t bytes_used() const { return used + overflow_bytes; }
+    size_t capacity() const { return block.size(); }
+    // allocations that didn't fit in the block and went to the heap, since the arena was created
+    uint64_t heap_allocations() const { return total_overflows; }
+
+private:
+    void *do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void *p, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+
+    std::vector<std::byte> block;
+    size_t used {0};
+    // allocations from the heap this tick, freed by reset()
+    struct Overflow {
+        void *p;
+        size_t bytes;
+        size_t alignment;
+    };
+    std::vector<Overflow> overflows;
+    size_t overflow_bytes {0};
+    uint64_t total_overflows {0};
+};
+
+#endif // TICK_ARENA_H
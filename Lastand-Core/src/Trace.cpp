@@ -0,0 +1,160 @@
+#include "Trace.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// spans kept per thread, about 1.5 MB each (a couple of seconds of a busy server)
+constexpr uint64_t trace_buffer_capacity {1 << 16};
+
+namespace {
+
+struct TraceEvent {
+    // read by dump_trace() while the owning thread may be writing, hence atomic (relaxed is enough)
+    std::atomic<const char *> name {nullptr};
+    std::atomic<uint64_t> start_ns {0};
+    std::atomic<uint64_t> duration_ns {0};
+};
+
+struct TraceBuffer {
+    uint32_t tid;
+    // a copy, so the name can be built by the thread; guarded by buffers_mutex
+    std::string thread_name;
+    std::array<TraceEvent, trace_buffer_capacity> events;
+    // spans ever recorded, the last trace_buffer_capacity of them are in events
+    std::atomic<uint64_t> written {0};
+};
+
+std::atomic<bool> enabled {false};
+// only taken when a thread records its first span and while dumping, never while recording
+std::mutex buffers_mutex;
+std::vector<std::unique_ptr<TraceBuffer>> buffers;
+thread_local TraceBuffer *thread_buffer {nullptr};
+thread_local std::string pending_thread_name;
+
+uint64_t now_ns() {
+    static const auto epoch {std::chrono::steady_clock::now()};
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+TraceBuffer *get_thread_buffer() {
+    if (thread_buffer)
+        return thread_buffer;
+    auto buffer {std::make_unique<TraceBuffer>()};
+    std::lock_guard<std::mutex> lock {buffers_mutex};
+    buffer->thread_name = pending_thread_name;
+    buffer->tid = static_cast<uint32_t>(buffers.size() + 1);
+    thread_buffer = buffer.get();
+    buffers.push_back(std::move(buffer));
+    return thread_buffer;
+}
+
+void write_json_string(std::ostream &os, const char *s) {
+    os << '"';
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            os << '\\';
+        os << *s;
+    }
+    os << '"';
+}
+
+}
+
+void set_tracing(bool on) {
+    now_ns(); // starts the clock at 0
+    enabled.store(on, std::memory_order_relaxed);
+}
+
+bool tracing() {
+    return enabled.load(std::memory_order_relaxed);
+}
+
+void trace_thread_name(const std::string &name) {
+    pending_thread_name = name;
+    if (thread_buffer) {
+        std::lock_guard<std::mutex> lock {buffers_mutex};
+        thread_buffer->thread_name = name;
+    }
+}
+
+TraceSpan::TraceSpan(const char *name): name {name}, start_ns {tracing() ? now_ns() : 0} {}
+
+TraceSpan::~TraceSpan() {
+    // also skips spans that started before tracing was turned on
+    if (start_ns == 0 || !tracing())
+        return;
+    uint64_t end_ns {now_ns()};
+    TraceBuffer *buffer {get_thread_buffer()};
+    uint64_t index {buffer->written.load(std::memory_order_relaxed)};
+    TraceEvent &event {buffer->events[index % trace_buffer_capacity]};
+    event.name.store(name, std::memory_order_relaxed);
+    event.start_ns.store(start_ns, std::memory_order_relaxed);
+    event.duration_ns.store(end_ns - start_ns, std::memory_order_relaxed);
+    buffer->written.store(index + 1, std::memory_order_release);
+}
+
+bool dump_trace(const std::string &file_name) {
+    std::ofstream file {file_name};
+    if (!file) {
+        std::cerr << "Couldn't open " << file_name << " to write the trace to" << std::endl;
+        return false;
+    }
+    file << std::fixed << std::setprecision(3) << "{\"traceEvents\":[\n";
+    bool first {true};
+    size_t num_spans {0};
+    auto separator = [&]() -> std::ostream & {
+        if (!first)
+            file << ",\n";
+        first = false;
+        return file;
+    };
+
+    std::lock_guard<std::mutex> lock {buffers_mutex};
+    for (const auto &buffer : buffers) {
+        if (!buffer->thread_name.empty()) {
+            separator() << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << buffer->tid << ",\"args\":{\"name\":";
+            write_json_string(file, buffer->thread_name.c_str());
+            file << "}}";
+        }
+
+        uint64_t end {buffer->written.load(std::memory_order_acquire)};
+        uint64_t begin {end > trace_buffer_capacity ? end - trace_buffer_capacity : 0};
+        struct Span {
+            const char *name;
+            uint64_t start_ns, duration_ns;
+        };
+        std::vector<Span> spans;
+        spans.reserve(end - begin);
+        for (uint64_t i {begin}; i < end; i++) {
+            const TraceEvent &event {buffer->events[i % trace_buffer_capacity]};
+            spans.push_back({event.name.load(std::memory_order_relaxed), event.start_ns.load(std::memory_order_relaxed),
+                             event.duration_ns.load(std::memory_order_relaxed)});
+        }
+        // the thread kept recording while these were copied, the oldest ones may have been overwritten since
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t end_after {buffer->written.load(std::memory_order_relaxed)};
+        uint64_t first_intact {end_after >= trace_buffer_capacity ? end_after - trace_buffer_capacity + 1 : 0};
+        for (uint64_t i {std::max(begin, first_intact)}; i < end; i++) {
+            const Span &span {spans[i - begin]};
+            separator() << "{\"ph\":\"X\",\"name\":";
+            write_json_string(file, span.name);
+            file << ",\"pid\":1,\"tid\":" << buffer->tid << ",\"ts\":" << span.start_ns / 1000.0 << ",\"dur\":" << span.duration_ns / 1000.0 << '}';
+            num_spans++;
+        }
+    }
+    file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    if (!file) {
+        std::cerr << "Couldn't write the trace to " << file_name << std::endl;
+        return false;
+    }
+    std::cout << "Wrote " << num_spans << " trace spans to " << file_name << std::endl;
+    return true;
+}
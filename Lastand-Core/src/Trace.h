@@ -0,0 +1,39 @@
+#pragma once
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstdint>
+#include <string>
+
+// Timeline of what each thread was doing, for finding the one tick or frame that stalled.
+//
+// TRACE_SCOPE("name") records a span from where it is to the end of the scope. Spans go into a
+// fixed-size buffer owned by the thread recording them, without locks, overwriting the oldest ones
+// once it is full. dump_trace() writes them in the Chrome trace-event JSON format, which can be
+// opened in chrome://tracing or https://ui.perfetto.dev. Nothing is recorded until set_tracing(true).
+
+void set_tracing(bool enabled);
+bool tracing();
+// names the calling thread in the trace, the name is copied
+void trace_thread_name(const std::string &name);
+// writes the spans still in the buffers of every thread, returns false if the file couldn't be written
+bool dump_trace(const std::string &file_name);
+
+class TraceSpan {
+public:
+    // name has to outlive the program (a string literal), only the pointer is kept
+    explicit TraceSpan(const char *name);
+    ~TraceSpan();
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+private:
+    const char *name;
+    uint64_t start_ns;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) TraceSpan TRACE_CONCAT(trace_span_, __LINE__) {name}
+
+#endif // TRACE_H
@@ -3,6 +3,8 @@
 
 #define __CONSTANTS_H__
 
+#include <cstdint>
+
 constexpr double tick_rate_ms {1.0 / 120 * 1000};
 
 constexpr short channel_events {0};
@@ -12,4 +14,8 @@ constexpr short num_channels = 3;
 
 constexpr int window_size {600};
 
+// reason given to enet_peer_disconnect() when a server running several matches sends a client to another
+// one, or'ed with the port the client should connect to instead
+constexpr uint32_t disconnect_redirect {1 << 16};
+
 #endif // __CONSTANTS_H__
@@ -1,4 +1,6 @@
 #include "physics.h"
+#include <algorithm>
+#include <array>
 #include "Player.h"
 #include <cmath>
 #include <iostream>
@@ -9,52 +11,96 @@ bool point_in_rect(int x, int y, int width, int height, int px, int py) {
     return (x <= px && px <= x + width && y <= py && py <= y + height);
 }
 
+// whether a corner of the player at (vx, vy) touches the obstacle, either by being inside it
+// or by being within 1 unit of one of its sides
+static bool vertex_touches_obstacle(int vx, int vy, int obstacle_x, int obstacle_y, int obstacle_width, int obstacle_height) {
+    // Obstacle bounds
+    uint16_t obstacle_right = obstacle_x + (obstacle_width * 2);
+    uint16_t obstacle_bottom = obstacle_y + (obstacle_height * 2);
+    uint16_t obstacle_left = obstacle_x;
+    uint16_t obstacle_top = obstacle_y;
+
+    int obstacle_side1_x {obstacle_left};
+    int obstacle_side2_x {obstacle_right};
+
+    int obstacle_side1_y {obstacle_top};
+    int obstacle_side2_y {obstacle_bottom};
+
+    if (point_in_rect(obstacle_x, obstacle_y, obstacle_width * 2, obstacle_height * 2, vx, vy)) {
+        #ifdef DEBUG
+        std::cout << "Player collided with obstacle at: (" << vx << ", " << vy << ")" << '\n';
+        #endif
+        return true;
+    }
+    for (auto side_x : {obstacle_side1_x, obstacle_side2_x}) {
+        if (!is_within(side_x, vx, 1.0) || vy < obstacle_top || vy > obstacle_bottom) {
+            continue;
+        }
+        #ifdef DEBUG
+        std::cout << "Vertical collision: x:" << side_x << " vs (" << vx << ", " << vy << ")" << '\n';
+        #endif
+        return true;
+    }
+    for (auto side_y : {obstacle_side1_y, obstacle_side2_y}) {
+        if (!is_within(side_y, vy, 1.0) || vx < obstacle_left || vx > obstacle_right) {
+            continue;
+        }
+        #ifdef DEBUG
+        std::cout << "Horizontal collision: y:" << side_y << " vs (" << vx << ", " << vy << ")" << '\n';
+        #endif
+        return true;
+    }
+    return false;
+}
+
+static std::array<std::pair<int, int>, 4> player_vertices(const Player &player) {
+    return {{
+        {player.x, player.y},
+        {player.x + player_size * 2, player.y},
+        {player.x, player.y + player_size * 2},
+        {player.x + player_size * 2, player.y + player_size * 2},
+    }};
+}
+
 bool detect_collision(const Player& player, const std::vector<Obstacle>& obstacles) {
     // verticies of the player
-    std::pair<int, int> v1 {player.x, player.y};
-    std::pair<int, int> v2 {player.x + player_size * 2, player.y};
-    std::pair<int, int> v3 {player.x, player.y + player_size * 2};
-    std::pair<int, int> v4 {player.x + player_size * 2, player.y + player_size * 2};
+    auto vertices = player_vertices(player);
     for (auto obstacle : obstacles) {
-        // Obstacle bounds
-        uint16_t obstacle_right = obstacle.x + (obstacle.width * 2);
-        uint16_t obstacle_bottom = obstacle.y + (obstacle.height * 2);
-        uint16_t obstacle_left = obstacle.x;
-        uint16_t obstacle_top = obstacle.y;
-
-        int obstacle_side1_x {obstacle_left};
-        int obstacle_side2_x {obstacle_right};
-        
-        int obstacle_side1_y {obstacle_top};
-        int obstacle_side2_y {obstacle_bottom};
-
-        for (auto v : {v1, v2, v3, v4}) {
-            if (point_in_rect(obstacle.x, obstacle.y, obstacle.width * 2, obstacle.height * 2, v.first, v.second)) {
-                #ifdef DEBUG
-                std::cout << "Player collided with obstacle at: (" << v.first << ", " << v.second << ")" << '\n';
-                #endif
-                return true;
-            }
-            for (auto side_x : {obstacle_side1_x, obstacle_side2_x}) {
-                if (!is_within(side_x, v.first, 1.0) || v.second < obstacle_top || v.second > obstacle_bottom) {
-                    continue;
-                }
-                #ifdef DEBUG
-                std::cout << "Vertical collision: x:" << side_x << " vs (" << v.first << ", " << v.second << ")" << '\n';
-                #endif
+        for (auto v : vertices) {
+            if (vertex_touches_obstacle(v.first, v.second, obstacle.x, obstacle.y, obstacle.width, obstacle.height))
                 return true;
-            }
-            for (auto side_y : {obstacle_side1_y, obstacle_side2_y}) {
-                if (!is_within(side_y, v.second, 1.0) || v.first < obstacle_left || v.first > obstacle_right) {
-                    continue;
-                }
-                #ifdef DEBUG
-                std::cout << "Horizontal collision: y:" << side_y << " vs (" << v.first << ", " << v.second << ")" << '\n';
-                #endif
-                return true;
-            }
         }
     }
     return false;
 }
 
+bool detect_collision(const Player& player, const CompiledMap& map) {
+    auto [begin, end] = map.player_bounds_near(player.x, player.y);
+    return std::any_of(begin, end, [&player](const PlayerBounds &b) { return b.contains(player.x, player.y); });
+}
+
+CollisionResult detect_collision(const Player& player, std::pair<short, short> movement, const CompiledMap& map) {
+    auto blocked = [&](short dx, short dy) {
+        Player moved {player};
+        moved.move(std::make_pair(dx, dy));
+        return detect_collision(moved, map);
+    };
+    bool blocked_x {movement.first != 0 && blocked(movement.first, 0)};
+    bool blocked_y {movement.second != 0 && blocked(0, movement.second)};
+
+    CollisionResult result {};
+    result.touch = blocked_x || blocked_y;
+    result.axis = blocked_x && blocked_y ? CollisionAxis::Both :
+        blocked_x ? CollisionAxis::Horizontal :
+        blocked_y ? CollisionAxis::Vertical : CollisionAxis::None;
+    result.allowed_directions = ClientMovement::None;
+    if (movement.first != 0 && !blocked_x)
+        result.allowed_directions |= movement.first < 0 ? ClientMovement::Left : ClientMovement::Right;
+    if (movement.second != 0 && !blocked_y)
+        result.allowed_directions |= movement.second < 0 ? ClientMovement::Up : ClientMovement::Down;
+    return result;
+}
+
+bool point_in_obstacle(int x, int y, const CompiledMap& map) {
+    return map.occupancy().is_solid(x, y);
+}
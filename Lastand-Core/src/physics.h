@@ -1,3 +1,5 @@
+#pragma once
+#include "CompiledMap.h"
 #include "Obstacle.h"
 #include "Player.h"
 #include "serialize.h"
@@ -12,10 +14,18 @@ enum class CollisionAxis {
 struct CollisionResult {
     bool touch;                 // Whether the player and obstacle touch
     CollisionAxis axis;         // Axis of collision, if any
-    bool overlap;               // Whether they overlap
     ClientMovement allowed_directions;
 };
 
 bool point_in_rect(int x, int y, int width, int height, int px, int py);
 bool detect_collision(const Player& player, const std::vector<Obstacle>& obstacles);
+// same as above, but with the map's obstacles grown by the size of the player, so only the player's
+// top left corner is tested against the ones near it
+bool detect_collision(const Player& player, const CompiledMap& map);
+// Whether the player can move by movement (-1, 0 or 1 on each axis), each axis on its own. touch and axis
+// say which moves hit an obstacle (Horizontal for the x one) and allowed_directions has the directions of
+// movement that don't hit anything
+CollisionResult detect_collision(const Player& player, std::pair<short, short> movement, const CompiledMap& map);
+// whether (x, y) is inside an obstacle, edges included, from the map's occupancy bitmap
+bool point_in_obstacle(int x, int y, const CompiledMap& map);
 
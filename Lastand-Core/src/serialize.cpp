@@ -1,5 +1,6 @@
 #include "serialize.h"
 #include "Projectile.h"
+#include <algorithm>
 #include <array>
 #include <cstdint>
 #include <iterator>
@@ -66,6 +67,27 @@ std::array<uint8_t, 4> serialize_coordinates(uint16_t x, uint16_t y) {
     return result;
 }
 
+bool deserialize_varint(const std::vector<uint8_t> &data, size_t &idx, uint32_t &val) {
+    val = 0;
+    for (int shift {0}; shift < 32; shift += 7) {
+        if (idx >= data.size())
+            return false;
+        uint8_t byte = data[idx++];
+        val |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false; // too many bytes for 32 bits
+}
+
+bool deserialize_player_id(const std::vector<uint8_t> &data, size_t &idx, PlayerId &id) {
+    uint32_t val;
+    if (!deserialize_varint(data, idx, val) || val > UINT16_MAX)
+        return false;
+    id = static_cast<PlayerId>(val);
+    return true;
+}
+
 std::vector<uint8_t> serialize_player(const Player &player) {
     std::vector<uint8_t> result;
     result.reserve(sizeof(Player));
@@ -75,7 +97,7 @@ std::vector<uint8_t> serialize_player(const Player &player) {
         result.push_back(c);
     }
 
-    result.push_back(player.id);
+    serialize_varint(result, player.id);
 
     auto color {serialize_color(player.color)};
     for (auto c : color) {
@@ -95,29 +117,36 @@ std::vector<uint8_t> serialize_player(const Player &player) {
     return result;
 }
 
+bool deserialize_player(const std::vector<uint8_t> &data, size_t &idx, Player &p) {
+    if (idx + 4 > data.size())
+        return false;
+    p.x = deserialize_uint16(data[idx], data[idx + 1]);
+    p.y = deserialize_uint16(data[idx + 2], data[idx + 3]);
+    idx += 4;
+
+    if (!deserialize_player_id(data, idx, p.id) || idx + 5 > data.size())
+        return false;
+    p.color = {data[idx], data[idx + 1], data[idx + 2], data[idx + 3]};
+
+    uint8_t username_length = data[idx + 4];
+    idx += 5;
+    if (idx + username_length > data.size())
+        return false;
+    p.username.assign(data.begin() + idx, data.begin() + idx + username_length);
+    idx += username_length;
+    return true;
+}
+
 Player deserialize_player(const std::vector<uint8_t> &data) {
-    if (data.size() <= 10) {
+    Player p;
+    size_t idx {0};
+    if (!deserialize_player(data, idx, p)) {
         std::cerr << "Not enough data to deserialize a player, data: " << data << std::endl;
         throw std::runtime_error("Not enough data to deserialize a player");
     }
-
-    Player p {data[4]}; // data[4] is the player id
-    uint16_t x = deserialize_uint16(data[0], data[1]);
-    uint16_t y = deserialize_uint16(data[2], data[3]);
-    p.x = x;
-    p.y = y;
-
-    p.color = {data[5], data[6], data[7], data[8]};
-    
-    uint8_t username_length = data[9];
-    if (username_length + 9 != data.size() - 1) {
-        std::cerr << "Warning: Username length mismatch: " << (int)username_length + 9 << " vs " << data.size() - 1 << std::endl;
-    }
-    std::string username;
-    for (size_t i {10}; i < data.size(); i++) {
-        username.push_back(data[i]);
+    if (idx != data.size()) {
+        std::cerr << "Warning: Username length mismatch: " << idx << " vs " << data.size() << std::endl;
     }
-    p.username = username;
     return p;
 }
 
@@ -201,160 +230,210 @@ void update_player_delta(ClientMovement movement, bool key_up, std::pair<short,
 }
 
 // takes in a vector of players that were updated by the server and serializes them
-std::vector<uint8_t> serialize_game_player_positions(const std::vector<Player> &players) {
-    std::vector<uint8_t> result;
-    result.reserve(players.size() * 5 + 1);
-    if (players.size() > 255) {
-        std::cerr << "Player vector too big to serialize!" << players.size() << std::endl;
-        return {};
-    }
-    result.push_back(static_cast<uint8_t>(players.size()));
+template <typename Players, typename Bytes>
+static void serialize_game_player_positions_to(const Players &players, Bytes &result) {
+    result.reserve(result.size() + players.size() * 7 + 3);
+    serialize_varint(result, static_cast<uint32_t>(players.size()));
     for (const auto &p: players) {
-        result.push_back(p.id);
+        serialize_varint(result, p.id);
         auto coordinates {serialize_coordinates(p.x, p.y)};
         for (auto c : coordinates) {
             result.push_back(c);
         }
     }
-    return result;
 }
 
-void deserialize_and_update_game_player_positions(const std::vector<uint8_t> &data, std::map<int, Player> &players) {
-    if (data.size() < 1) return;
-    uint8_t num_players = data[0];
-    if (data.size() != num_players * 5 + 1) {
-        std::cerr << "Not enough data to deserialize players, data:" << data << std::endl;
-        return;
-    }
+std::vector<uint8_t> serialize_game_player_positions(const std::vector<Player> &players) {
+    std::vector<uint8_t> result;
+    serialize_game_player_positions_to(players, result);
+    return result;
+}
 
-    for (size_t curr_player = 1; curr_player <= data.size() - 5; curr_player += 5) {
-        int id = data[curr_player];
-        auto &p = players[id];
-        uint16_t x = deserialize_uint16(data[curr_player + 1], data[curr_player + 2]);
-        uint16_t y = deserialize_uint16(data[curr_player + 3], data[curr_player + 4]);
-        p.x = x;
-        p.y = y;
-    }
+void serialize_game_player_positions(const std::pmr::vector<Player> &players, std::pmr::vector<uint8_t> &data) {
+    serialize_game_player_positions_to(players, data);
 }
 
-std::vector<uint8_t> serialize_previous_game_data(const std::vector<Player> &players, const std::vector<Obstacle> &obstacles) {
-    std::vector<uint8_t> player_data;
-    for (const auto &p : players) {
-        auto player = serialize_player(p);
-        player_data.insert(player_data.end(), player.begin(), player.end());
-    }
-    std::vector<uint8_t> obstacle_data;
-    std::cout << "obstacles size: " << obstacles.size() << std::endl;
-    int obstacle_index {0};
-    for (const auto &obs: obstacles) {
-        auto data = serialize_obstacle(obs);
-        obstacle_data.insert(obstacle_data.cend(), data.begin(), data.end());
-        obstacle_index++;
-#ifdef DEBUG
-        if (obstacle_index % 10 == 0) {
-            std::cout << "Processed obstacle " << obstacle_index << std::endl;
+void deserialize_and_update_game_player_positions(const std::vector<uint8_t> &data, std::map<int, Player> &players) {
+    size_t idx {0};
+    uint32_t num_players;
+    if (!deserialize_varint(data, idx, num_players)) return;
+
+    for (uint32_t i {0}; i < num_players; i++) {
+        PlayerId id;
+        if (!deserialize_player_id(data, idx, id) || idx + 4 > data.size()) {
+            std::cerr << "Not enough data to deserialize players, data:" << data << std::endl;
+            return;
         }
-#endif
+        auto &p = players[id];
+        p.x = deserialize_uint16(data[idx], data[idx + 1]);
+        p.y = deserialize_uint16(data[idx + 2], data[idx + 3]);
+        idx += 4;
     }
+}
 
-    std::cout << "Player data size: " << player_data.size() << std::endl;
-    std::cout << "Obstacle data size: " << obstacle_data.size() << std::endl;
-
-    if (player_data.empty() && obstacle_data.empty()) {
-        std::cout << "Not sending previous game data as it is empty" << std::endl;
-        return {};
-    }
+static void push_uint16(std::vector<uint8_t> &data, uint16_t val) {
+    auto [high_byte, low_byte] = serialize_uint16(val);
+    data.push_back(high_byte);
+    data.push_back(low_byte);
+}
 
-    std::vector<uint8_t> previous_game_data {
-        static_cast<uint8_t>(ObjectType::Player),
-        static_cast<uint8_t>(players.size()),
+// packs already serialized objects of one type into WorldChunk messages of at most max_chunk_size bytes
+static std::vector<std::vector<uint8_t>> serialize_chunks(ObjectType type, const std::vector<std::vector<uint8_t>> &objects, size_t max_chunk_size) {
+    std::vector<std::vector<uint8_t>> chunks;
+    std::vector<uint8_t> chunk;
+    uint16_t objects_in_chunk {0};
+
+    auto finish_chunk = [&]() {
+        if (objects_in_chunk == 0)
+            return;
+        auto [high_byte, low_byte] = serialize_uint16(objects_in_chunk);
+        chunk[world_chunk_header_size - 2] = high_byte;
+        chunk[world_chunk_header_size - 1] = low_byte;
+        chunks.push_back(std::move(chunk));
+        chunk.clear();
+        objects_in_chunk = 0;
     };
-    previous_game_data.reserve(player_data.size() + obstacle_data.size() + 7);
-    previous_game_data.insert(previous_game_data.cend(), player_data.begin(), player_data.end());
 
-    previous_game_data.push_back(static_cast<uint8_t>(ObjectType::Obstacle));
-    previous_game_data.push_back(static_cast<uint8_t>(obstacles.size()));
-    previous_game_data.insert(previous_game_data.cend(), obstacle_data.begin(), obstacle_data.end());
+    for (const auto &object : objects) {
+        if (chunk.size() + object.size() > max_chunk_size || objects_in_chunk == UINT16_MAX)
+            finish_chunk();
+        if (chunk.empty()) {
+            chunk.reserve(max_chunk_size);
+            chunk.push_back(static_cast<uint8_t>(MessageToClientTypes::WorldChunk));
+            push_uint16(chunk, static_cast<uint16_t>(chunks.size()));
+            chunk.push_back(static_cast<uint8_t>(type));
+            push_uint16(chunk, 0); // filled in by finish_chunk()
+        }
+        chunk.insert(chunk.end(), object.begin(), object.end());
+        objects_in_chunk++;
+    }
+    finish_chunk();
 
-    std::cout << "Previous game data size: " << previous_game_data.size() << std::endl;
-    return previous_game_data;
+#ifdef DEBUG
+    std::cout << "Split " << objects.size() << " objects of type " << (int)type << " into " << chunks.size() << " chunks" << std::endl;
+#endif
+    return chunks;
 }
 
-std::pair<std::map<int, Player>, std::vector<Obstacle>> deserialize_and_update_previous_game_data(const std::vector<uint8_t> &data) {
-    std::map<int, Player> players;
-    std::vector<Obstacle> obstacles;
+std::vector<std::vector<uint8_t>> serialize_player_chunks(const std::vector<Player> &players, size_t max_chunk_size) {
+    std::vector<std::vector<uint8_t>> objects;
+    objects.reserve(players.size());
+    for (const auto &p : players)
+        objects.push_back(serialize_player(p));
+    return serialize_chunks(ObjectType::Player, objects, max_chunk_size);
+}
 
-#ifdef DEBUG
-    std::cout << "Parsing Previous game data: " << data << std::endl;
-#endif
-    
-    ObjectType type = static_cast<ObjectType>(data[0]);
-    if (type != ObjectType::Player) {
-        std::cerr << "Previous game data does not have player data!" << std::endl;
-        return {players, obstacles};
+std::vector<std::vector<uint8_t>> serialize_obstacle_chunks(const std::vector<Obstacle> &obstacles, size_t max_chunk_size) {
+    std::vector<std::vector<uint8_t>> objects;
+    objects.reserve(obstacles.size());
+    for (const auto &o : obstacles) {
+        auto data = serialize_obstacle(o);
+        objects.emplace_back(data.begin(), data.end());
     }
+    return serialize_chunks(ObjectType::Obstacle, objects, max_chunk_size);
+}
 
-    uint8_t num_players = data[1];
-    std::cout << "Player count: " << (int)num_players << std::endl;
-    int curr_data_idx {2};
-    for (size_t curr_player = 0; curr_player < num_players; curr_player++) {
-        uint8_t username_length = data[curr_data_idx + 9];
-
-        auto player_data_begin = data.begin();
-        std::advance(player_data_begin, curr_data_idx);
+std::vector<uint8_t> serialize_map_info(const MapInfo &info) {
+    std::vector<uint8_t> result {static_cast<uint8_t>(MessageToClientTypes::MapInfo)};
+    for (auto half : {static_cast<int32_t>(info.hash >> 32), static_cast<int32_t>(info.hash & 0xFFFFFFFF)}) {
+        auto bytes = serialize_int32(half);
+        result.insert(result.end(), bytes.begin(), bytes.end());
+    }
+    push_uint16(result, info.num_obstacles);
+    push_uint16(result, info.num_chunks);
+    return result;
+}
 
-        auto player_data_end = data.begin();
-        std::advance(player_data_end, curr_data_idx + 10 + username_length);
+MapInfo deserialize_map_info(const std::vector<uint8_t> &data) {
+    if (data.size() < 12) {
+        std::cerr << "Not enough data to deserialize map info, data: " << data << std::endl;
+        return {};
+    }
+    uint32_t high = static_cast<uint32_t>(deserialize_int32({data[0], data[1], data[2], data[3]}));
+    uint32_t low = static_cast<uint32_t>(deserialize_int32({data[4], data[5], data[6], data[7]}));
+    return {
+        (static_cast<uint64_t>(high) << 32) | low,
+        deserialize_uint16(data[8], data[9]),
+        deserialize_uint16(data[10], data[11])
+    };
+}
 
-        std::vector<uint8_t> player_data(player_data_begin, player_data_end);
-        Player p {deserialize_player(player_data)};
-#ifdef DEBUG
-        std::cout << "Player: " << p.username << ": " << "(" << p.x << ", " << p.y << ")(" << p.color.r << ", " << p.color.g << ", " << p.color.b << ", " << p.color.a << ")\n";
-        std::cout << "Player data: " << player_data << std::endl;
-#endif
+std::vector<uint8_t> serialize_world_complete(uint16_t num_chunks, uint16_t num_players, uint16_t num_obstacles) {
+    std::vector<uint8_t> result {static_cast<uint8_t>(MessageToClientTypes::WorldComplete)};
+    push_uint16(result, num_chunks);
+    push_uint16(result, num_players);
+    push_uint16(result, num_obstacles);
+    return result;
+}
 
-        players[p.id] = p;
-        curr_data_idx += player_data.size();
+int deserialize_world_chunk(const std::vector<uint8_t> &data, std::map<int, Player> &players, std::vector<Obstacle> &obstacles, ObjectType &type) {
+    if (data.size() < world_chunk_header_size - 1) {
+        std::cerr << "Not enough data to deserialize a world chunk, data: " << data << std::endl;
+        return -1;
     }
-    
-    type = static_cast<ObjectType>(data[curr_data_idx]);
-    if (type != ObjectType::Obstacle) {
-        std::cerr << "Previous game data does not have obstacle data! " << (int)type << ", " << curr_data_idx << std::endl;
-        return {players, obstacles};
-    }
-
-    curr_data_idx++;
-    int num_obstacles = data[curr_data_idx];
-    std::cout << "Parsing " << num_obstacles << " obstacles" << std::endl;
-    curr_data_idx++;
-    for (size_t curr_obstacle = 0; curr_obstacle < num_obstacles; curr_obstacle++) {
-        auto obstacle_data_begin = data.begin();
-        std::advance(obstacle_data_begin, curr_data_idx);
-
-        auto obstacle_data_end = data.begin();
-        std::advance(obstacle_data_end, curr_data_idx + obstacle_data_size);
-
-        std::array<uint8_t, obstacle_data_size> obstacle_data;
-        int i {0};
-        for (auto elm = obstacle_data_begin; elm != obstacle_data_end; elm++) {
-            obstacle_data[i] = *elm;
-            i++;
+    uint16_t chunk_idx = deserialize_uint16(data[0], data[1]);
+    type = static_cast<ObjectType>(data[2]);
+    uint16_t num_objects = deserialize_uint16(data[3], data[4]);
+
+    size_t curr_data_idx {world_chunk_header_size - 1};
+    for (uint16_t i {0}; i < num_objects; i++) {
+        if (type == ObjectType::Player) {
+            Player p;
+            if (!deserialize_player(data, curr_data_idx, p)) {
+                std::cerr << "World chunk " << chunk_idx << " ends in the middle of a player" << std::endl;
+                return -1;
+            }
+            players[p.id] = p;
+        } else if (type == ObjectType::Obstacle) {
+            if (curr_data_idx + obstacle_data_size > data.size()) {
+                std::cerr << "World chunk " << chunk_idx << " ends in the middle of an obstacle" << std::endl;
+                return -1;
+            }
+            std::array<uint8_t, obstacle_data_size> obstacle_data;
+            std::copy_n(data.begin() + curr_data_idx, obstacle_data_size, obstacle_data.begin());
+            obstacles.push_back(deserialize_obstacle(obstacle_data));
+            curr_data_idx += obstacle_data_size;
+        } else {
+            std::cerr << "Unknown object type in world chunk " << chunk_idx << ": " << (int)type << std::endl;
+            return -1;
         }
-#ifdef DEBUG
-        std::cout << "Obstacle data(" << obstacle_data.size() << "): " << obstacle_data << std::endl;
-#endif
-        Obstacle o {deserialize_obstacle(obstacle_data)};
-
-        obstacles.push_back(o);
-        curr_data_idx += obstacle_data_size;
     }
 
-    std::cout << "curr_data_idx: " << curr_data_idx << std::endl;
     if (curr_data_idx != data.size()) {
-        std::cerr << "Previous game data is not fully parsed! " << data.size() << std::endl;
+        std::cerr << "World chunk " << chunk_idx << " is not fully parsed! " << curr_data_idx << " vs " << data.size() << std::endl;
     }
+    return chunk_idx;
+}
 
-    return {players, obstacles};
+WorldComplete deserialize_world_complete(const std::vector<uint8_t> &data) {
+    if (data.size() < 6) {
+        std::cerr << "Not enough data to deserialize world completion, data: " << data << std::endl;
+        return {};
+    }
+    return {
+        deserialize_uint16(data[0], data[1]),
+        deserialize_uint16(data[2], data[3]),
+        deserialize_uint16(data[4], data[5])
+    };
+}
+
+size_t bundled_message_size(size_t message_size) {
+    size_t length_size {1};
+    for (size_t size {message_size}; size >= 0x80; size >>= 7)
+        length_size++;
+    return length_size + message_size;
+}
+
+bool deserialize_bundle(const std::vector<uint8_t> &data, std::vector<std::vector<uint8_t>> &messages) {
+    size_t idx {0};
+    while (idx < data.size()) {
+        uint32_t length;
+        if (!deserialize_varint(data, idx, length) || length == 0 || length > data.size() - idx)
+            return false;
+        messages.emplace_back(data.begin() + idx, data.begin() + idx + length);
+        idx += length;
+    }
+    return true;
 }
 
 ClientMovement operator|(ClientMovement c1, ClientMovement c2) {
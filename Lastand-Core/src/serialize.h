@@ -8,13 +8,15 @@
 #include "Obstacle.h"
 #include "Projectile.h"
 #include <map>
+#include <memory_resource>
 
 enum class MessageToServerTypes: uint8_t {
     ClientMove = 0, // input from player to go up, down, left, right
     SetClientAttributes = 1, // used for setting the username or color of player
     Shoot = 2, // when the player shoots a projectile
     ReadyUp = 3, // when the player is ready to start the game
-    UnReady = 4 // when the player is not ready to start the game
+    UnReady = 4, // when the player is not ready to start the game
+    RequestMap = 5 // the map from MapInfo isn't cached by the player, so the server should send its obstacles
 };
 
 enum class ClientMovementTypes: uint8_t {
@@ -45,17 +47,27 @@ enum class MessageToClientTypes: uint8_t {
     // data from serialize_game_player_positions() should be after this
     UpdatePlayerPositions = 0,
 
-    // player attributes (username or color) have changed
+    // player attributes (username or color) have changed: attribute type, varint player id, attribute
     SetPlayerAttributes = 1,
-    PlayerKilled = 2, // a player has killed another player
-    PlayerLeft = 3, // a player has left
+    PlayerKilled = 2, // a player has killed another player: varint killer id, varint killed id
+    PlayerLeft = 3, // a player has left: varint player id
     PlayerJoined = 4, // a player has joined
-    PlayerWon = 5, // a player has won
-    // sent when a player joins late
+    PlayerWon = 5, // a player has won: varint player id
+    // no longer sent, the world is streamed to joining players with WorldChunk
     PreviousGameData = 6,
-    // projectiles have moved
+    // projectiles have moved: varint count, then the projectiles from serialize_projectile()
     UpdateProjectiles = 7,
-    GameStarted = 8
+    GameStarted = 8,
+    // part of the world (players or obstacles) sent to a player that just joined,
+    // data from serialize_player_chunks() or serialize_obstacle_chunks() is the whole message
+    WorldChunk = 9,
+    // sent after the last player WorldChunk, data from serialize_world_complete()
+    WorldComplete = 10,
+    // hash of the map, sent when a player joins. The obstacle chunks are only sent
+    // if the player replies with RequestMap. data from serialize_map_info() is the whole message
+    MapInfo = 11,
+    // several messages sent together in one packet, see append_bundled_message()
+    Bundle = 12
 };
 
 enum class ObjectType: uint8_t {
@@ -68,8 +80,25 @@ enum class SetPlayerAttributesTypes: uint8_t {
     ColorChanged = 1
 };
 
+// LEB128 style variable length integers: 7 bits per byte, the high bit is set if more bytes follow.
+// Player ids and object counts use these so small values (the usual case) only take one byte
+// Bytes is std::vector<uint8_t> or, for the vectors in the tick arena, std::pmr::vector<uint8_t>
+template <typename Bytes>
+void serialize_varint(Bytes &data, uint32_t val) {
+    while (val >= 0x80) {
+        data.push_back(static_cast<uint8_t>(val | 0x80));
+        val >>= 7;
+    }
+    data.push_back(static_cast<uint8_t>(val));
+}
+// reads a varint starting at idx and moves idx past it, returns false if the data ends first
+bool deserialize_varint(const std::vector<uint8_t> &data, size_t &idx, uint32_t &val);
+bool deserialize_player_id(const std::vector<uint8_t> &data, size_t &idx, PlayerId &id);
+
 std::vector<uint8_t> serialize_player(const Player &player);
 Player deserialize_player(const std::vector<uint8_t> &data);
+// reads a player starting at idx and moves idx past it, returns false if the data ends in the middle of it
+bool deserialize_player(const std::vector<uint8_t> &data, size_t &idx, Player &p);
 
 constexpr int obstacle_data_size = 12;
 
@@ -79,15 +108,57 @@ Obstacle deserialize_obstacle(const std::array<uint8_t, obstacle_data_size> &dat
 void update_player_delta(ClientMovement movement, bool key_up, std::pair<short, short> &player_delta);
 
 std::vector<uint8_t> serialize_game_player_positions(const std::vector<Player> &players);
+// the same, appended to data
+void serialize_game_player_positions(const std::pmr::vector<Player> &players, std::pmr::vector<uint8_t> &data);
 void deserialize_and_update_game_player_positions(const std::vector<uint8_t> &data, std::map<int, Player> &players);
 
-std::vector<uint8_t> serialize_previous_game_data(const std::vector<Player> &players, const std::vector<Obstacle> &obstacles);
-std::pair<std::map<int, Player>, std::vector<Obstacle>> deserialize_and_update_previous_game_data(const std::vector<uint8_t> &data);
+// message type, uint16 chunk index, object type, uint16 object count
+constexpr size_t world_chunk_header_size = 6;
+// keeps every chunk within a single UDP datagram with ENet's default MTU
+constexpr size_t world_chunk_max_size = 1200;
+constexpr size_t bundle_max_size = world_chunk_max_size;
+
+struct WorldComplete {
+    uint16_t num_chunks;
+    uint16_t num_players;
+    uint16_t num_obstacles;
+};
+
+struct MapInfo {
+    uint64_t hash; // from hash_obstacles()
+    uint16_t num_obstacles;
+    uint16_t num_chunks;
+};
+
+// split players or obstacles into WorldChunk messages (including the message type).
+// chunk indices start at 0 for each type of object
+std::vector<std::vector<uint8_t>> serialize_player_chunks(const std::vector<Player> &players, size_t max_chunk_size = world_chunk_max_size);
+std::vector<std::vector<uint8_t>> serialize_obstacle_chunks(const std::vector<Obstacle> &obstacles, size_t max_chunk_size = world_chunk_max_size);
+std::vector<uint8_t> serialize_map_info(const MapInfo &info);
+MapInfo deserialize_map_info(const std::vector<uint8_t> &data);
+std::vector<uint8_t> serialize_world_complete(uint16_t num_chunks, uint16_t num_players, uint16_t num_obstacles);
+// adds the objects in a chunk (without the message type) to the world,
+// returns the chunk index or -1 if it is malformed. type is set to the type of objects in the chunk
+int deserialize_world_chunk(const std::vector<uint8_t> &data, std::map<int, Player> &players, std::vector<Obstacle> &obstacles, ObjectType &type);
+WorldComplete deserialize_world_complete(const std::vector<uint8_t> &data);
+
+// a Bundle is the message type followed by each message (including its type) prefixed with its length as a varint
+template <typename Bytes>
+void append_bundled_message(Bytes &bundle, const Bytes &message) {
+    serialize_varint(bundle, static_cast<uint32_t>(message.size()));
+    bundle.insert(bundle.end(), message.begin(), message.end());
+}
+// bytes a message of message_size bytes takes in a Bundle
+size_t bundled_message_size(size_t message_size);
+// splits a Bundle (without the message type) into its messages, returns false if it is malformed
+bool deserialize_bundle(const std::vector<uint8_t> &data, std::vector<std::vector<uint8_t>> &messages);
 
 std::array<uint8_t, 12> serialize_projectile(Projectile p);
 Projectile deserialize_projectile(const std::array<uint8_t, 12> &data);
 
 
+std::pair<uint8_t, uint8_t> serialize_uint16(uint16_t val);
+uint16_t deserialize_uint16(uint8_t high_byte, uint8_t low_byte);
 int32_t deserialize_int32(std::array<uint8_t, 4> data);
 std::array<uint8_t, 4> serialize_int32(int32_t val);
 
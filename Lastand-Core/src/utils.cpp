@@ -5,7 +5,30 @@ bool is_within(int a, int b, double c) {
     return d <= c;
 }
 
+// state of the splitmix64 generator behind random_uint32(), the same seed always gives the same numbers.
+// Every thread has its own, so matches running on different threads don't take each other's numbers
+static thread_local uint64_t random_state {0x853c49e6748fea9bULL};
+
+void seed_random(uint64_t seed) {
+    random_state = seed;
+}
+
+uint32_t random_uint32() {
+    uint64_t z = (random_state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return static_cast<uint32_t>((z ^ (z >> 31)) >> 32);
+}
+
 Color random_color() {
-    return {static_cast<uint8_t>(rand() % 200 + 56), static_cast<uint8_t>(rand() % 200 + 56), static_cast<uint8_t>(rand() % 200 + 56), 255};
+    return {static_cast<uint8_t>(random_uint32() % 200 + 56), static_cast<uint8_t>(random_uint32() % 200 + 56), static_cast<uint8_t>(random_uint32() % 200 + 56), 255};
 }
 
+
+uint64_t fnv1a_64(const uint8_t *data, size_t length, uint64_t hash) {
+    for (size_t i {0}; i < length; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
@@ -34,5 +34,11 @@ std::ostream &operator<<(std::ostream &os, const std::array<T, n> &v) {
 
 bool is_within(int a, int b, double c);
 
+// seeds the calling thread's generator used by random_uint32() and random_color(), so a game can be replayed exactly
+void seed_random(uint64_t seed);
+uint32_t random_uint32();
 Color random_color();
 
+
+// 64-bit FNV-1a, used to fingerprint map content
+uint64_t fnv1a_64(const uint8_t *data, size_t length, uint64_t hash = 0xcbf29ce484222325ULL);
@@ -0,0 +1,46 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include "CompiledMap.h"
+#include "Obstacle.h"
+
+// Compiles the text maps in resources/maps into the binary format loaded by the server.
+//
+// usage: Lastand-MapCompiler <map.txt> [<map.lmap>]
+// if no output file is given, the output is written next to the input with a .lmap extension
+int main(int argv, char **argc) {
+    if (argv < 2 || argv > 3) {
+        std::cerr << "usage: " << argc[0] << " <map.txt> [<map.lmap>]" << std::endl;
+        return 1;
+    }
+
+    std::string input {argc[1]};
+    std::string output;
+    if (argv == 3) {
+        output = argc[2];
+    } else {
+        auto extension = input.rfind(".txt");
+        output = (extension == std::string::npos ? input : input.substr(0, extension)) + ".lmap";
+    }
+
+    std::vector<Obstacle> obstacles {load_from_file(input)};
+    if (obstacles.empty()) {
+        std::cerr << "No obstacles found in " << input << std::endl;
+        return 1;
+    }
+
+    if (!write_compiled_map(output, obstacles)) {
+        std::cerr << "Failed to write " << output << std::endl;
+        return 1;
+    }
+
+    // make sure what was written can be loaded again
+    CompiledMap map;
+    if (!map.open(output) || map.obstacle_count() != obstacles.size()) {
+        std::cerr << "Failed to load back " << output << std::endl;
+        return 1;
+    }
+    std::cout << "Compiled " << input << " -> " << output << ": " << map.obstacle_count()
+              << " obstacles, hash " << std::hex << map.content_hash() << std::dec << std::endl;
+    return 0;
+}
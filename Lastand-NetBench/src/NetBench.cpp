@@ -0,0 +1,210 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <enet/enet.h>
+#include "constants.h"
+
+// Measures how fast datagrams go through the loopback interface, first straight through the
+// sockets with a system call per datagram (enet_socket_send/receive) and in batches
+// (enet_socket_send_batch/receive_batch, sendmmsg/recvmmsg on Linux), then through ENet hosts
+// with a server sending a snapshot to every client and receiving an input from each per tick.
+// The ENet part runs whichever path ENet was built with, build with -DENET_BATCHED_IO=ON and OFF
+// to compare them.
+//
+// usage: Lastand-NetBench [datagrams] [datagram size] [clients] [ticks]
+
+// datagrams in flight at once, so the receiving socket's buffer never overflows
+constexpr size_t burst_size {ENET_DATAGRAM_BATCH_MAXIMUM};
+
+struct SocketPair {
+    ENetSocket sender {ENET_SOCKET_NULL};
+    ENetSocket receiver {ENET_SOCKET_NULL};
+    ENetAddress receiver_address {};
+
+    ~SocketPair() {
+        enet_socket_destroy(sender);
+        enet_socket_destroy(receiver);
+    }
+};
+
+bool open_sockets(SocketPair &sockets) {
+    ENetAddress address {};
+    enet_address_set_host_ip(&address, "127.0.0.1");
+    sockets.sender = enet_socket_create(ENET_SOCKET_TYPE_DATAGRAM);
+    sockets.receiver = enet_socket_create(ENET_SOCKET_TYPE_DATAGRAM);
+    if (sockets.sender == ENET_SOCKET_NULL || sockets.receiver == ENET_SOCKET_NULL ||
+        enet_socket_bind(sockets.receiver, &address) < 0 || enet_socket_get_address(sockets.receiver, &sockets.receiver_address) < 0) {
+        std::cerr << "Couldn't open the sockets" << std::endl;
+        return false;
+    }
+    enet_socket_set_option(sockets.sender, ENET_SOCKOPT_NONBLOCK, 1);
+    enet_socket_set_option(sockets.receiver, ENET_SOCKOPT_NONBLOCK, 1);
+    return true;
+}
+
+// sends the datagrams in bursts and receives each burst before the next one, returns the datagrams received
+size_t run_sockets(bool batched, size_t datagrams, size_t datagram_size) {
+    SocketPair sockets;
+    if (!open_sockets(sockets))
+        return 0;
+
+    std::vector<uint8_t> out_data(datagram_size, 0x5a);
+    std::vector<std::vector<uint8_t>> in_data(burst_size, std::vector<uint8_t>(ENET_PROTOCOL_MAXIMUM_MTU));
+    std::vector<ENetDatagram> out(burst_size), in(burst_size);
+    for (auto &datagram : out) {
+        datagram.address = sockets.receiver_address;
+        datagram.buffer.data = out_data.data();
+        datagram.buffer.dataLength = out_data.size();
+    }
+
+    size_t sent {0}, received {0};
+    while (sent < datagrams) {
+        size_t burst {std::min(burst_size, datagrams - sent)};
+        if (batched) {
+            int result {enet_socket_send_batch(sockets.sender, out.data(), burst)};
+            if (result < 0)
+                return received;
+            burst = result;
+        } else {
+            for (size_t i {0}; i < burst; i++) {
+                if (enet_socket_send(sockets.sender, &sockets.receiver_address, &out[i].buffer, 1) < 0)
+                    return received;
+            }
+        }
+        sent += burst;
+
+        // loopback delivers synchronously, everything sent is already waiting
+        size_t burst_received {0};
+        while (burst_received < burst) {
+            int result;
+            if (batched) {
+                for (size_t i {0}; i < burst_size; i++) {
+                    in[i].buffer.data = in_data[i].data();
+                    in[i].buffer.dataLength = in_data[i].size();
+                }
+                result = enet_socket_receive_batch(sockets.receiver, in.data(), burst_size);
+            } else {
+                in[0].buffer.data = in_data[0].data();
+                in[0].buffer.dataLength = in_data[0].size();
+                result = enet_socket_receive(sockets.receiver, &in[0].address, &in[0].buffer, 1) > 0 ? 1 : 0;
+            }
+            if (result <= 0)
+                break;
+            burst_received += result;
+        }
+        received += burst_received;
+    }
+    return received;
+}
+
+void benchmark_sockets(size_t datagrams, size_t datagram_size) {
+    for (bool batched : {false, true}) {
+        auto start = std::chrono::steady_clock::now();
+        size_t received {run_sockets(batched, datagrams, datagram_size)};
+        std::chrono::duration<double> elapsed {std::chrono::steady_clock::now() - start};
+        std::cout << (batched ? "Batched:        " : "One at a time:  ") << received << " datagrams of " << datagram_size
+                  << " bytes in " << elapsed.count() * 1000 << " ms (" << received / elapsed.count() / 1000 << "k datagrams/s, "
+                  << received * datagram_size / elapsed.count() / (1024 * 1024) << " MiB/s)" << std::endl;
+    }
+}
+
+void drain(ENetHost *host) {
+    ENetEvent event;
+    while (enet_host_service(host, &event, 0) > 0) {
+        if (event.type == ENET_EVENT_TYPE_RECEIVE)
+            enet_packet_destroy(event.packet);
+    }
+}
+
+void benchmark_hosts(size_t clients, size_t ticks, size_t snapshot_size) {
+    ENetAddress address {};
+    enet_address_set_host_ip(&address, "127.0.0.1");
+    ENetHost *server {enet_host_create(&address, clients, num_channels, 0, 0)};
+    if (server == nullptr || enet_socket_get_address(server->socket, &address) < 0) {
+        std::cerr << "Couldn't create the server host" << std::endl;
+        return;
+    }
+    std::vector<ENetHost *> client_hosts;
+    for (size_t i {0}; i < clients; i++) {
+        ENetHost *client {enet_host_create(nullptr, 1, num_channels, 0, 0)};
+        if (client == nullptr || enet_host_connect(client, &address, num_channels, 0) == nullptr) {
+            std::cerr << "Couldn't create client host " << i << std::endl;
+            return;
+        }
+        client_hosts.push_back(client);
+    }
+    auto connect_start = std::chrono::steady_clock::now();
+    while (server->connectedPeers < clients && std::chrono::steady_clock::now() - connect_start < std::chrono::seconds {10}) {
+        drain(server);
+        for (ENetHost *client : client_hosts)
+            drain(client);
+    }
+    if (server->connectedPeers < clients) {
+        std::cerr << "Only " << server->connectedPeers << " of " << clients << " clients connected" << std::endl;
+        return;
+    }
+
+    std::vector<uint8_t> snapshot(snapshot_size, 0x5a);
+    uint8_t input[8] {};
+    std::chrono::duration<double> server_time {0};
+    uint32_t datagrams_before {server->totalSentPackets + server->totalReceivedPackets};
+    for (size_t tick {0}; tick < ticks; tick++) {
+        for (ENetHost *client : client_hosts) {
+            enet_peer_send(&client->peers[0], channel_user_updates, enet_packet_create(input, sizeof(input), ENET_PACKET_FLAG_UNSEQUENCED));
+            enet_host_flush(client);
+        }
+
+        // what the server does in a tick: take in the inputs, then send everyone a snapshot
+        auto start = std::chrono::steady_clock::now();
+        drain(server);
+        for (ENetPeer *peer {server->peers}; peer < &server->peers[server->peerCount]; peer++) {
+            if (peer->state == ENET_PEER_STATE_CONNECTED)
+                enet_peer_send(peer, channel_updates, enet_packet_create(snapshot.data(), snapshot.size(), ENET_PACKET_FLAG_UNSEQUENCED));
+        }
+        enet_host_flush(server);
+        server_time += std::chrono::steady_clock::now() - start;
+
+        for (ENetHost *client : client_hosts)
+            drain(client);
+    }
+    uint32_t datagrams {server->totalSentPackets + server->totalReceivedPackets - datagrams_before};
+
+#ifdef ENET_BATCHED_IO
+    std::cout << "ENet (batched): ";
+#else
+    std::cout << "ENet (one at a time): ";
+#endif
+    std::cout << clients << " clients, " << ticks << " ticks, " << server_time.count() * 1e6 / ticks << " us/tick in the server for "
+              << datagrams / ticks << " datagrams/tick" << std::endl;
+
+    for (ENetHost *client : client_hosts)
+        enet_host_destroy(client);
+    enet_host_destroy(server);
+}
+
+int main(int argv, char **argc) {
+    if (argv > 5) {
+        std::cerr << "usage: " << argc[0] << " [datagrams] [datagram size] [clients] [ticks]" << std::endl;
+        return 1;
+    }
+    size_t datagrams {argv > 1 ? std::stoul(argc[1]) : 1000000};
+    size_t datagram_size {argv > 2 ? std::stoul(argc[2]) : 200};
+    size_t clients {argv > 3 ? std::stoul(argc[3]) : 100};
+    size_t ticks {argv > 4 ? std::stoul(argc[4]) : 1200};
+    if (datagram_size == 0 || datagram_size > ENET_HOST_DEFAULT_MTU) {
+        std::cerr << "The datagram size has to be between 1 and " << ENET_HOST_DEFAULT_MTU << std::endl;
+        return 1;
+    }
+
+    if (enet_initialize() != 0) {
+        std::cerr << "Couldn't initialize enet" << std::endl;
+        return 1;
+    }
+    benchmark_sockets(datagrams, datagram_size);
+    benchmark_hosts(clients, ticks, datagram_size);
+    enet_deinitialize();
+    return 0;
+}
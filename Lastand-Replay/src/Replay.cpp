@@ -0,0 +1,102 @@
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "CompiledMap.h"
+#include "ReplayLog.h"
+#include "serialize.h"
+#include "GameState.h"
+#include "utils.h"
+
+// Re-runs a game recorded by the server (Lastand-Server <port> <replay file>) as fast as possible,
+// so the same game can be profiled over and over.
+//
+// usage: Lastand-Replay <replay file> <map> [times to run]
+// map is the path to the map without the extension, e.g. maps/map2
+
+struct ReplayResult {
+    uint32_t ticks {0};
+    int kills {0};
+    size_t players_left {0};
+    // hash of where every player ended up, the same for every run of the same replay
+    uint64_t state_hash {0};
+};
+
+ReplayResult run_replay(const std::vector<ReplayEvent> &events, const CompiledMap &map, uint64_t seed, const GameRules &rules) {
+    seed_random(seed);
+    ReplayResult result;
+    GameState state {map, rules};
+    // inputs are applied on the tick after they were received, like on the server
+    std::vector<GameInput> pending_inputs;
+
+    for (const auto &event : events) {
+        while (state.tick() < event.tick) {
+            for (const auto &game_event : state.step(pending_inputs)) {
+                if (game_event.type == GameEventType::PlayerKilled)
+                    result.kills++;
+            }
+            pending_inputs.clear();
+        }
+
+        switch (event.type) {
+            case ReplayEventType::Connect:
+                state.add_player(event.player_id);
+                break;
+            case ReplayEventType::Disconnect:
+                state.remove_player(event.player_id);
+                break;
+            case ReplayEventType::Input: {
+                GameInput input;
+                if (parse_game_input(event.data.data(), event.data.size(), event.player_id, input))
+                    pending_inputs.push_back(input);
+                break;
+            }
+            case ReplayEventType::Tick:
+                break;
+        }
+    }
+
+    result.ticks = state.tick();
+    result.players_left = state.players().size();
+    result.state_hash = fnv1a_64(nullptr, 0);
+    for (const auto &[id, data] : state.players()) {
+        uint8_t player_state[6] {static_cast<uint8_t>(data.p.id >> 8), static_cast<uint8_t>(data.p.id), static_cast<uint8_t>(data.p.x >> 8), static_cast<uint8_t>(data.p.x), static_cast<uint8_t>(data.p.y >> 8), static_cast<uint8_t>(data.p.y)};
+        result.state_hash = fnv1a_64(player_state, sizeof(player_state), result.state_hash);
+    }
+    return result;
+}
+
+int main(int argv, char **argc) {
+    if (argv < 3 || argv > 4) {
+        std::cerr << "usage: " << argc[0] << " <replay file> <map> [times to run]" << std::endl;
+        return 1;
+    }
+    int times {argv == 4 ? std::stoi(argc[3]) : 1};
+
+    ReplayReader reader;
+    if (!reader.open(argc[1]))
+        return 1;
+    std::vector<ReplayEvent> events;
+    ReplayEvent event;
+    while (reader.next(event))
+        events.push_back(event);
+
+    CompiledMap map {load_map(argc[2])};
+    if (map.content_hash() != reader.map_hash) {
+        std::cerr << "Warning: the replay was recorded on map " << std::hex << reader.map_hash
+                  << " but " << argc[2] << " is " << map.content_hash() << std::dec << std::endl;
+    }
+    std::cout << "Replaying " << events.size() << " events, seed " << reader.seed << std::endl;
+
+    for (int run {0}; run < times; run++) {
+        auto start = std::chrono::steady_clock::now();
+        ReplayResult result {run_replay(events, map, reader.seed, reader.rules)};
+        std::chrono::duration<double> elapsed {std::chrono::steady_clock::now() - start};
+
+        std::cout << "Run " << run + 1 << ": " << result.ticks << " ticks in " << elapsed.count() * 1000 << " ms ("
+                  << result.ticks / elapsed.count() << " ticks/s), " << result.kills << " kills, "
+                  << result.players_left << " players left, state " << std::hex << result.state_hash << std::dec << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,114 @@
+#include "AdminSocket.h"
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+// more connections than this are closed right after being accepted
+constexpr size_t max_connections {4};
+// a command longer than this closes the connection
+constexpr size_t max_line_length {256};
+
+AdminSocket::~AdminSocket() {
+    for (const auto &connection : connections)
+        enet_socket_destroy(connection.socket);
+    if (listener != ENET_SOCKET_NULL)
+        enet_socket_destroy(listener);
+}
+
+bool AdminSocket::open(uint16_t port) {
+    ENetAddress address {};
+    enet_address_set_host_ip(&address, "127.0.0.1");
+    address.port = port;
+    listener = enet_socket_create(ENET_SOCKET_TYPE_STREAM);
+    if (listener == ENET_SOCKET_NULL)
+        return false;
+    enet_socket_set_option(listener, ENET_SOCKOPT_REUSEADDR, 1);
+    enet_socket_set_option(listener, ENET_SOCKOPT_NONBLOCK, 1);
+    if (enet_socket_bind(listener, &address) < 0 || enet_socket_listen(listener, static_cast<int>(max_connections)) < 0) {
+        enet_socket_destroy(listener);
+        listener = ENET_SOCKET_NULL;
+        return false;
+    }
+    return true;
+}
+
+void AdminSocket::poll(uint32_t timeout_ms) {
+    ENetSocketSet sockets;
+    ENET_SOCKETSET_EMPTY(sockets);
+    ENET_SOCKETSET_ADD(sockets, listener);
+    ENetSocket max_socket {listener};
+    for (const auto &connection : connections) {
+        ENET_SOCKETSET_ADD(sockets, connection.socket);
+        max_socket = std::max(max_socket, connection.socket);
+    }
+    if (enet_socketset_select(max_socket, &sockets, nullptr, timeout_ms) <= 0)
+        return;
+
+    // read before accepting, so a new connection isn't looked at before select() has been asked about it
+    auto closed = std::remove_if(connections.begin(), connections.end(), [&](Connection &connection) {
+        if (!ENET_SOCKETSET_CHECK(sockets, connection.socket) || receive(connection))
+            return false;
+        enet_socket_destroy(connection.socket);
+        return true;
+    });
+    connections.erase(closed, connections.end());
+
+    if (ENET_SOCKETSET_CHECK(sockets, listener)) {
+        ENetAddress address {};
+        ENetSocket socket {enet_socket_accept(listener, &address)};
+        if (socket == ENET_SOCKET_NULL)
+            return;
+        if (connections.size() >= max_connections) {
+            enet_socket_destroy(socket);
+            return;
+        }
+        enet_socket_set_option(socket, ENET_SOCKOPT_NONBLOCK, 1);
+        connections.push_back({socket, {}});
+    }
+}
+
+bool AdminSocket::receive(Connection &connection) {
+    char data[max_line_length];
+    ENetBuffer buffer {};
+    buffer.data = data;
+    buffer.dataLength = sizeof(data);
+    // select() said there is something to read, nothing means the other end closed the connection
+    int received {enet_socket_receive(connection.socket, nullptr, &buffer, 1)};
+    if (received <= 0)
+        return false;
+
+    connection.line.append(data, received);
+    size_t end;
+    while ((end = connection.line.find('\n')) != std::string::npos) {
+        std::string command {connection.line.substr(0, end)};
+        connection.line.erase(0, end + 1);
+        if (!command.empty() && command.back() == '\r')
+            command.pop_back();
+        std::string reply {run_command(command) + '\n'};
+        ENetBuffer reply_buffer {};
+        reply_buffer.data = reply.data();
+        reply_buffer.dataLength = reply.size();
+        if (enet_socket_send(connection.socket, nullptr, &reply_buffer, 1) < 0)
+            return false;
+    }
+    return connection.line.size() < max_line_length;
+}
+
+std::string AdminSocket::run_command(const std::string &command) {
+    std::istringstream words {command};
+    std::string verb, key, value;
+    words >> verb >> key >> value;
+    if (verb == "get") {
+        std::ostringstream reply;
+        reply << "started with " << config << "; now " << live;
+        return reply.str();
+    }
+    if (verb == "set" && !key.empty() && !value.empty()) {
+        std::string error;
+        if (!live.set(config, key, value, error))
+            return "error: " + error;
+        std::cout << "Admin set " << key << " to " << value << std::endl;
+        return "ok";
+    }
+    return "error: expected get or set <option> <value>";
+}
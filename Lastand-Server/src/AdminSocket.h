@@ -0,0 +1,44 @@
+#pragma once
+#ifndef ADMIN_SOCKET_H
+#define ADMIN_SOCKET_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <enet/enet.h>
+#include "ServerConfig.h"
+
+// A TCP port on localhost for changing the LiveSettings without restarting the server, e.g. with
+// `nc localhost <admin_port>`. Every command is a line and is answered with a line:
+//
+//   get                   the config the server started with and the current live settings
+//   set <option> <value>  changes snapshot_interval, max_players, peer_bytes_per_second or log_level
+//
+// It only listens on the loopback interface, anyone who can connect to it can change the settings.
+class AdminSocket {
+public:
+    AdminSocket(const ServerConfig &config, LiveSettings &live): config {config}, live {live} {}
+    ~AdminSocket();
+
+    bool open(uint16_t port);
+    // waits up to timeout_ms for connections and commands, and answers the commands
+    void poll(uint32_t timeout_ms);
+
+private:
+    struct Connection {
+        ENetSocket socket;
+        // what has been received of the next command
+        std::string line;
+    };
+
+    std::string run_command(const std::string &command);
+    // false if the connection was closed and should be dropped
+    bool receive(Connection &connection);
+
+    const ServerConfig &config;
+    LiveSettings &live;
+    ENetSocket listener {ENET_SOCKET_NULL};
+    std::vector<Connection> connections;
+};
+
+#endif // ADMIN_SOCKET_H
@@ -0,0 +1,27 @@
+#include "AllocationCounter.h"
+#include <cstdlib>
+#include <new>
+
+// the global operator new and delete are replaced to count the allocations. The array and nothrow
+// versions call these, ENet's allocations come from the packet pools and aren't counted.
+// Counted per thread, so each shard only sees its own ticks' allocations
+static thread_local uint64_t allocations {0};
+
+uint64_t heap_allocations() {
+    return allocations;
+}
+
+void *operator new(std::size_t size) {
+    allocations++;
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc {};
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
@@ -0,0 +1,10 @@
+#pragma once
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+#include <cstdint>
+
+// number of times operator new has been called on this thread, to check that ticks don't touch the heap
+uint64_t heap_allocations();
+
+#endif // ALLOCATION_COUNTER_H
@@ -0,0 +1,82 @@
+#include "CongestionController.h"
+#include <algorithm>
+#include "constants.h"
+
+// ticks between looking at a peer's statistics
+constexpr uint32_t evaluate_interval {30};
+// good evaluations in a row before the quality goes back up one level
+constexpr uint32_t evaluations_to_recover {8};
+
+// the link is congested past any of these
+constexpr double congested_loss {0.05};
+constexpr uint32_t congested_rtt_ms {200};
+constexpr double congested_throttle {0.5};
+// and good below all of these
+constexpr double good_loss {0.01};
+constexpr uint32_t good_rtt_ms {120};
+constexpr double good_throttle {0.9};
+
+// the most bytes that can be saved up for a burst, as a fraction of a second's budget
+constexpr double max_burst {0.25};
+// reliable packets needed before the loss of a window is measured
+constexpr uint32_t min_window_reliable {8};
+
+CongestionController::CongestionController(uint32_t bytes_per_second, uint32_t phase, double tick_ms):
+    bytes_per_second {bytes_per_second}, tick_ms {tick_ms}, phase {phase}, tokens {bytes_per_second * max_burst} {}
+
+void CongestionController::update(const ENetPeer *peer, uint32_t tick) {
+    double ticks_per_second {1000.0 / tick_ms};
+    tokens = std::min(tokens + bytes_per_second / ticks_per_second, bytes_per_second * max_burst);
+
+    if ((tick + phase) % evaluate_interval != 0)
+        return;
+    // a window's loss only counts against the peer once, not at every evaluation until the next window ends
+    bool new_loss {measure_loss(peer)};
+    double throttle {static_cast<double>(peer->packetThrottle) / ENET_PEER_PACKET_THROTTLE_SCALE};
+    uint32_t rtt {peer->roundTripTime};
+
+    if ((new_loss && loss > congested_loss) || rtt > congested_rtt_ms || throttle < congested_throttle) {
+        level = std::min(level + 1, num_snapshot_qualities - 1);
+        good_evaluations = 0;
+    } else if (loss < good_loss && rtt < good_rtt_ms && throttle >= good_throttle) {
+        if (++good_evaluations >= evaluations_to_recover && level > 0) {
+            level--;
+            good_evaluations = 0;
+        }
+    } else {
+        good_evaluations = 0;
+    }
+}
+
+bool CongestionController::measure_loss(const ENetPeer *peer) {
+    // updated in place, this runs during ticks which don't allocate
+    bool first_evaluation {last_sequence_numbers.size() != peer->channelCount + 1};
+    if (first_evaluation)
+        last_sequence_numbers.assign(peer->channelCount + 1, 0);
+    for (size_t i {0}; i < last_sequence_numbers.size(); i++) {
+        uint16_t sequence_number {i == 0 ? peer->outgoingReliableSequenceNumber : peer->channels[i - 1].outgoingReliableSequenceNumber};
+        if (!first_evaluation)
+            window_reliable += static_cast<uint16_t>(sequence_number - last_sequence_numbers[i]);
+        last_sequence_numbers[i] = sequence_number;
+    }
+
+    // ENet resets packetsLost every time it updates packetLoss
+    window_lost += peer->packetsLost >= last_packets_lost ? peer->packetsLost - last_packets_lost : peer->packetsLost;
+    last_packets_lost = peer->packetsLost;
+
+    if (window_reliable < min_window_reliable)
+        return false;
+    loss = std::min(1.0, static_cast<double>(window_lost) / window_reliable);
+    loss = std::max(loss, static_cast<double>(peer->packetLoss) / ENET_PEER_PACKET_LOSS_SCALE);
+    window_reliable = 0;
+    window_lost = 0;
+    return true;
+}
+
+bool CongestionController::should_send_snapshot(uint32_t tick, uint32_t interval_scale) const {
+    return (tick + phase) % (quality().interval_ticks * interval_scale) == 0 && tokens > 0;
+}
+
+void CongestionController::snapshot_sent(size_t bytes) {
+    tokens -= bytes;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#ifndef CONGESTION_CONTROLLER_H
+#define CONGESTION_CONTROLLER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <enet/enet.h>
+#include "constants.h"
+
+// how much of the game a peer is sent in the unreliable snapshots (player positions and projectiles)
+struct SnapshotQuality {
+    // a snapshot is sent every this many ticks
+    uint32_t interval_ticks;
+    // only players and projectiles this close to the peer's player are sent, 0 for everything
+    uint16_t aoi_radius;
+    // a player that stopped moving is still sent in this many more snapshots, in case the last ones were lost
+    uint32_t redundancy;
+};
+
+// from the best quality (everything at the tick rate) to the worst
+constexpr SnapshotQuality snapshot_qualities[] {
+    {1, 0, 2},
+    {2, 0, 3},
+    {3, 800, 3},
+    {4, 600, 4},
+    {6, 400, 4},
+};
+constexpr size_t num_snapshot_qualities {sizeof(snapshot_qualities) / sizeof(snapshot_qualities[0])};
+
+// Picks the snapshot quality for a peer from the round trip time, packet loss and throttle ENet
+// measures for it, so a player on a bad link gets less data instead of more retransmissions.
+// The quality drops as soon as the link looks congested and only comes back after it has been
+// good for a while. On top of that, snapshots are skipped when they would go over bytes_per_second.
+class CongestionController {
+public:
+    CongestionController(uint32_t bytes_per_second, uint32_t phase, double tick_ms = tick_rate_ms);
+
+    // call once per tick, before should_send_snapshot()
+    void update(const ENetPeer *peer, uint32_t tick);
+    // interval_scale stretches the interval of every quality, for servers that send fewer snapshots than they tick
+    bool should_send_snapshot(uint32_t tick, uint32_t interval_scale = 1) const;
+    void snapshot_sent(size_t bytes);
+    // changes the budget, e.g. when the server's setting is changed while it runs
+    void set_bytes_per_second(uint32_t bytes) { bytes_per_second = bytes; }
+
+    size_t quality_level() const { return level; }
+    // share of the reliable packets that had to be resent in the last window that ended
+    double reliable_loss() const { return loss; }
+    const SnapshotQuality &quality() const { return snapshot_qualities[level]; }
+
+private:
+    uint32_t bytes_per_second;
+    double tick_ms;
+    // spreads the snapshots of peers at the same quality over different ticks
+    uint32_t phase;
+    // ENet's packetLoss is only updated every 10 seconds and counts lost reliable packets against every
+    // packet sent, most of which are unreliable snapshots. This is the share of reliable packets that had to
+    // be resent, measured over windows of at least a few reliable packets. Returns true when a window ends
+    bool measure_loss(const ENetPeer *peer);
+
+    size_t level {0};
+    uint32_t good_evaluations {0};
+    double loss {0.0};
+    // reliable sequence numbers of each channel and the peer itself, and packetsLost, at the last evaluation
+    std::vector<uint16_t> last_sequence_numbers;
+    uint32_t last_packets_lost {0};
+    uint32_t window_reliable {0};
+    uint32_t window_lost {0};
+    // token bucket for the byte budget, can go negative after a big snapshot
+    double tokens;
+};
+
+#endif // CONGESTION_CONTROLLER_H
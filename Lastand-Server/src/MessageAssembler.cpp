@@ -0,0 +1,142 @@
+#include "MessageAssembler.h"
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+#include "constants.h"
+#include "serialize.h"
+#include "Trace.h"
+
+MessageAssembler::MessageAssembler(std::pmr::memory_resource *arena): arena {arena} {}
+
+MessageAssembler::QueuedMessage MessageAssembler::make_message(const uint8_t *data, size_t size, const std::pmr::vector<ENetPeer *> &except) {
+    return {next_order++, std::pmr::vector<uint8_t>(data, data + size, arena), std::pmr::vector<ENetPeer *>(except.begin(), except.end(), arena)};
+}
+
+void MessageAssembler::forget(ENetPeer *peer) {
+    reliable_section.peers.erase(peer);
+    unreliable_section.peers.erase(peer);
+}
+
+void MessageAssembler::flush(const std::vector<ENetHost *> &hosts) {
+    TRACE_SCOPE("flush");
+    last_messages = 0;
+    last_packets = 0;
+    flush_section(hosts, reliable_section, true);
+    flush_section(hosts, unreliable_section, false);
+    // new containers, the old ones point into the arena that is about to be reset
+    reliable_section = Section {arena};
+    unreliable_section = Section {arena};
+}
+
+std::pmr::vector<std::pmr::vector<uint8_t>> MessageAssembler::pack(const std::pmr::vector<const QueuedMessage *> &messages) const {
+    std::pmr::vector<std::pmr::vector<uint8_t>> packets {arena};
+    std::pmr::vector<uint8_t> bundle {arena};
+    const QueuedMessage *only_message {nullptr};
+    size_t messages_in_bundle {0};
+
+    auto finish_bundle = [&]() {
+        if (messages_in_bundle == 1)
+            packets.push_back(only_message->data);
+        else if (messages_in_bundle > 1)
+            packets.push_back(std::move(bundle));
+        bundle.clear();
+        messages_in_bundle = 0;
+    };
+
+    for (const QueuedMessage *message : messages) {
+        if (bundle.size() + bundled_message_size(message->data.size()) > bundle_max_size)
+            finish_bundle();
+        if (bundle.empty())
+            bundle.push_back(static_cast<uint8_t>(MessageToClientTypes::Bundle));
+        append_bundled_message(bundle, message->data);
+        only_message = message;
+        messages_in_bundle++;
+    }
+    finish_bundle();
+    return packets;
+}
+
+void MessageAssembler::flush_section(const std::vector<ENetHost *> &hosts, Section &section, bool reliable) {
+    TRACE_SCOPE(reliable ? "flush reliable" : "flush unreliable");
+    int channel_id {reliable ? channel_events : channel_updates};
+    ENetPacketFlag flags {reliable ? ENET_PACKET_FLAG_RELIABLE : ENET_PACKET_FLAG_UNSEQUENCED};
+
+    // peers that get exactly the broadcasts share the same packets
+    std::pmr::vector<const QueuedMessage *> broadcasts {arena};
+    broadcasts.reserve(section.broadcasts.size());
+    for (const auto &message : section.broadcasts)
+        broadcasts.push_back(&message);
+    // which broadcasts each excluded peer doesn't get, marked once so the peers don't search the except lists
+    std::pmr::map<const ENetPeer *, std::pmr::vector<bool>> exclusions {arena};
+    for (size_t i {0}; i < broadcasts.size(); i++) {
+        for (const ENetPeer *peer : broadcasts[i]->except) {
+            auto &excluded = exclusions.try_emplace(peer, broadcasts.size(), false).first->second;
+            excluded[i] = true;
+        }
+    }
+    std::pmr::vector<ENetPacket *> shared_packets {arena};
+    for (const auto &data : pack(broadcasts)) {
+        ENetPacket *packet = enet_packet_create(data.data(), data.size(), flags);
+        // keeps the packet alive until every peer has been given it
+        packet->referenceCount++;
+        shared_packets.push_back(packet);
+    }
+
+    for (ENetHost *host : hosts) {
+        for (ENetPeer *peer {host->peers}; peer < &host->peers[host->peerCount]; peer++) {
+            if (peer->state != ENET_PEER_STATE_CONNECTED)
+                continue;
+            auto own_messages = section.peers.find(peer);
+            auto excluded = exclusions.find(peer);
+            if (own_messages == section.peers.end() && excluded == exclusions.end()) {
+                for (ENetPacket *packet : shared_packets) {
+                    if (enet_peer_send(peer, channel_id, packet) != 0)
+                        std::cerr << "Failed to send bundle to peer " << peer->incomingPeerID << std::endl;
+                    last_packets++;
+                }
+                last_messages += broadcasts.size();
+                continue;
+            }
+
+            std::pmr::vector<const QueuedMessage *> messages {arena};
+            for (size_t i {0}; i < broadcasts.size(); i++) {
+                if (excluded == exclusions.end() || !excluded->second[i])
+                    messages.push_back(broadcasts[i]);
+            }
+            if (own_messages != section.peers.end()) {
+                std::pmr::vector<const QueuedMessage *> merged {arena};
+                merged.reserve(messages.size() + own_messages->second.size());
+                auto by_order = [](const QueuedMessage *a, const QueuedMessage &b) { return a->order < b.order; };
+                auto own = own_messages->second.cbegin();
+                for (const auto *message : messages) {
+                    for (; own != own_messages->second.cend() && !by_order(message, *own); own++)
+                        merged.push_back(&*own);
+                    merged.push_back(message);
+                }
+                for (; own != own_messages->second.cend(); own++)
+                    merged.push_back(&*own);
+                messages = std::move(merged);
+            }
+            for (const auto &data : pack(messages)) {
+                ENetPacket *packet = enet_packet_create(data.data(), data.size(), flags);
+                if (enet_peer_send(peer, channel_id, packet) != 0) {
+                    std::cerr << "Failed to send bundle to peer " << peer->incomingPeerID << std::endl;
+                    enet_packet_destroy(packet);
+                }
+                last_packets++;
+            }
+            last_messages += messages.size();
+        }
+    }
+
+    for (ENetPacket *packet : shared_packets) {
+        packet->referenceCount--;
+        if (packet->referenceCount == 0)
+            enet_packet_destroy(packet);
+    }
+#ifdef DEBUG
+    if (!section.broadcasts.empty() || !section.peers.empty())
+        std::cout << "Flushed " << (reliable ? "reliable" : "unreliable") << " messages, " << last_messages << " message(s) in "
+                  << last_packets << " packet(s) so far this tick" << std::endl;
+#endif
+}
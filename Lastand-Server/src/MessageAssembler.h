@@ -0,0 +1,72 @@
+#pragma once
+#ifndef MESSAGE_ASSEMBLER_H
+#define MESSAGE_ASSEMBLER_H
+
+#include <cstdint>
+#include <map>
+#include <memory_resource>
+#include <vector>
+#include <enet/enet.h>
+
+// Collects the messages sent to players during a tick and packs them into as few packets as
+// possible when flushed, instead of sending a packet (and paying for its headers) per message.
+//
+// Reliable messages go out on channel_events and unreliable ones on channel_updates (unsequenced),
+// so a lost position update never holds up the reliable ones. Each packet is a Bundle of at most
+// bundle_max_size bytes, a packet with only one message in it is sent as the plain message.
+//
+// The queued messages are kept in the arena, which can be reset once flush() returns.
+class MessageAssembler {
+public:
+    explicit MessageAssembler(std::pmr::memory_resource *arena);
+
+    // Bytes is std::vector<uint8_t> or std::pmr::vector<uint8_t>, the message is copied into the arena
+    template <typename Bytes>
+    void send(ENetPeer *peer, const Bytes &message, bool reliable) {
+        section(reliable).peers[peer].push_back(make_message(message.data(), message.size()));
+    }
+    // sends the message to every connected peer, except the ones given
+    template <typename Bytes>
+    void broadcast(const Bytes &message, bool reliable, const std::pmr::vector<ENetPeer *> &except = {}) {
+        section(reliable).broadcasts.push_back(make_message(message.data(), message.size(), except));
+    }
+    // drops the messages queued for a peer that disconnected
+    void forget(ENetPeer *peer);
+    // packs and sends everything queued since the last flush to the peers of the hosts, after which
+    // nothing is left in the arena. Broadcasts go to the connected peers of every host
+    void flush(const std::vector<ENetHost *> &hosts);
+
+    // number of messages and packets sent by the last flush
+    size_t messages_flushed() const { return last_messages; }
+    size_t packets_flushed() const { return last_packets; }
+
+private:
+    struct QueuedMessage {
+        // messages to a peer are sent in the order they were queued, whether they were broadcast or not
+        uint64_t order;
+        std::pmr::vector<uint8_t> data;
+        std::pmr::vector<ENetPeer *> except;
+    };
+    // reliable or unreliable messages
+    struct Section {
+        explicit Section(std::pmr::memory_resource *arena): broadcasts {arena}, peers {arena} {}
+
+        std::pmr::vector<QueuedMessage> broadcasts;
+        std::pmr::map<ENetPeer *, std::pmr::vector<QueuedMessage>> peers;
+    };
+
+    Section &section(bool reliable) { return reliable ? reliable_section : unreliable_section; }
+    QueuedMessage make_message(const uint8_t *data, size_t size, const std::pmr::vector<ENetPeer *> &except = {});
+    void flush_section(const std::vector<ENetHost *> &hosts, Section &section, bool reliable);
+    // packs the messages into packets of at most bundle_max_size bytes (unless a single message is bigger)
+    std::pmr::vector<std::pmr::vector<uint8_t>> pack(const std::pmr::vector<const QueuedMessage *> &messages) const;
+
+    std::pmr::memory_resource *arena;
+    Section reliable_section {arena};
+    Section unreliable_section {arena};
+    uint64_t next_order {0};
+    size_t last_messages {0};
+    size_t last_packets {0};
+};
+
+#endif // MESSAGE_ASSEMBLER_H
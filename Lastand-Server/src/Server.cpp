@@ -1,5 +1,6 @@
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
 #include <cmath>
 #include <cstddef>
@@ -9,65 +10,141 @@
 #include <iostream>
 #include <ostream>
 #include <string>
+#include <thread>
+#include "CompiledMap.h"
 #include "Obstacle.h"
 #include "Projectile.h"
 #include "constants.h"
 #include "Player.h"
 #include "serialize.h"
 #include <map>
+#include <memory_resource>
 #include <utility>
 #include <vector>
 #include <chrono>
-#include "physics.h"
+#include <csignal>
+#include <cstdlib>
+#include <random>
+#include "ReplayLog.h"
+#include "Compression.h"
+#include "CongestionController.h"
+#include "GameState.h"
+#include "IdAllocator.h"
+#include "AdminSocket.h"
+#include "AllocationCounter.h"
+#include "MessageAssembler.h"
+#include "NetworkEmulator.h"
+#include "PacketPool.h"
+#include "ServerConfig.h"
+#include "ShardDirectory.h"
+#include "TickArena.h"
+#include "Trace.h"
 #include "utils.h"
 
-int players_connected {0};
-const int max_players = 100;
-const Player default_player {0, 0, {255, 255, 255, 255}, "Player", 0};
+// ENet's allocation pools start out big enough for this many players and grow past it
+const size_t pooled_players = 100;
+// seconds of ticks between printing how well packets are compressing
+const uint32_t compression_stats_interval_s = 60;
 
-// the most top left the player can go
-constexpr uint16_t min_x {0};
-constexpr uint16_t min_y {0};
+// starting size of the arena for what is sent during a tick, it grows to fit the biggest tick
+const size_t tick_arena_size = 256 * 1024;
 
-// the most bottom right the player can go
-constexpr uint16_t max_x {(window_size - player_size) * 2};
-constexpr uint16_t max_y {(window_size - player_size) * 2};
+// a lobby where nobody is moving ticks this slowly, until someone sends an input or the game starts
+const double lobby_idle_tick_rate_ms = 100;
+// a match nobody is in doesn't tick at all, it only wakes up for packets and to check that the server is still running
+const uint32_t empty_wait_ms = 1000;
 
-// the maximum distance a projectile can travel in pixels
-constexpr uint16_t max_obstacle_distance_travelled {500};
+// set from the SIGUSR1 handler, the main thread writes the trace when it next checks
+volatile std::sig_atomic_t trace_dump_requested {0};
+// the matches run until this is false
+std::atomic<bool> running {true};
+// the options that can be changed through the admin socket
+LiveSettings live_settings;
 
+bool logging(LogLevel level) {
+    return level <= live_settings.log_level.load(std::memory_order_relaxed);
+}
+
+// what the server knows about a connected peer, the peer's data points to this
 struct ClientData {
-    Player p;
-    bool ready = false;
-    std::pair<short, short> player_movement;
+    PlayerId player_id;
+    ENetPeer *peer;
+    CongestionController congestion;
+};
+
+// what the server remembers between ticks to build snapshots
+struct SnapshotHistory {
+    std::map<PlayerId, uint32_t> last_moved_tick;
+    // last tick with a projectile in the game, an empty list is sent for a few snapshots after it
+    uint32_t last_projectile_tick {0};
 };
 
-// used in the server to store projectiles with decimal coordinates
-struct ProjectileDouble {
-    double x;
-    double y;
-    double dx;
-    double dy;
-    uint8_t player_id;
-    uint16_t start_x;
-    uint16_t start_y;
-
-    ProjectileDouble(Projectile p, uint8_t player_id)
-        : x{static_cast<double>(p.x)}, y{static_cast<double>(p.y)},
-          dx{p.dx / std::sqrt(std::pow(p.dx, 2) + std::pow(p.dy, 2))},
-          dy{std::sqrt(1 - dx * dx) * (p.dy < 0 ? -1 : 1)},
-          player_id{player_id},
-          start_x{p.x}, start_y{p.y}
-    {}
-
-    void move(uint8_t times = 1) {
-        for (uint8_t i = 0; i < times; i++) {
-            x += dx;
-            y += dy;
+// builds the UpdatePlayerPositions and UpdateProjectiles messages for a peer that is sent snapshots
+// at the given quality. viewer is the peer's player, nullptr if it is spectating. Everything is allocated from arena
+std::pmr::vector<std::pmr::vector<uint8_t>> build_snapshot(const GameState &state, const SnapshotHistory &history, const SnapshotQuality &quality, const Player *viewer,
+                                                         std::pmr::memory_resource *arena) {
+    TRACE_SCOPE("build snapshot");
+    uint32_t keep_ticks {quality.interval_ticks * quality.redundancy};
+    auto in_range = [&](int x, int y) {
+        if (quality.aoi_radius == 0 || viewer == nullptr)
+            return true;
+        int dx {x - viewer->x}, dy {y - viewer->y};
+        return dx * dx + dy * dy <= quality.aoi_radius * quality.aoi_radius;
+    };
+    std::pmr::vector<std::pmr::vector<uint8_t>> messages {arena};
+
+    std::pmr::vector<Player> players_to_update {arena};
+    for (const auto &[id, last_moved] : history.last_moved_tick) {
+        if (state.tick() - last_moved > keep_ticks)
+            continue;
+        auto player = state.players().find(id);
+        if (player != state.players().end() && in_range(player->second.p.x, player->second.p.y))
+            players_to_update.push_back(player->second.p);
+    }
+    if (!players_to_update.empty()) {
+        TRACE_SCOPE("serialize positions");
+        std::pmr::vector<uint8_t> data_to_send {arena};
+        data_to_send.push_back(static_cast<uint8_t>(MessageToClientTypes::UpdatePlayerPositions));
+        serialize_game_player_positions(players_to_update, data_to_send);
+        messages.push_back(std::move(data_to_send));
+    }
+
+    const auto &projectiles {state.projectiles()};
+    if (!projectiles.empty() || state.tick() - history.last_projectile_tick <= keep_ticks) {
+        TRACE_SCOPE("serialize projectiles");
+        std::pmr::vector<Projectile> projectiles_to_send {arena};
+        for (const auto &pd : projectiles) {
+            if (in_range(static_cast<int>(pd.x), static_cast<int>(pd.y)))
+                projectiles_to_send.push_back({static_cast<uint16_t>(pd.x), static_cast<uint16_t>(pd.y), static_cast<int32_t>(pd.dx), static_cast<int32_t>(pd.dy)});
+        }
+        std::pmr::vector<uint8_t> projectile_data {arena};
+        projectile_data.reserve(6 + projectiles_to_send.size() * sizeof(Projectile));
+        projectile_data.push_back(static_cast<uint8_t>(MessageToClientTypes::UpdateProjectiles));
+        serialize_varint(projectile_data, static_cast<uint32_t>(projectiles_to_send.size()));
+        for (const auto &p : projectiles_to_send) {
+            auto p_data = serialize_projectile(p);
+            projectile_data.insert(projectile_data.end(), p_data.cbegin(), p_data.cend());
         }
+        messages.push_back(std::move(projectile_data));
     }
-};
+    return messages;
+}
 
+// whether a step would change nothing in a lobby: no inputs to apply and no player moving
+bool lobby_is_idle(const GameState &state, const std::vector<GameInput> &pending_inputs) {
+    if (state.game_started() || !pending_inputs.empty())
+        return false;
+    return std::all_of(state.players().begin(), state.players().end(), [](const auto &player) {
+        return player.second.player_movement == std::make_pair<short, short>(0, 0);
+    });
+}
+
+size_t snapshot_size(const std::pmr::vector<std::pmr::vector<uint8_t>> &messages) {
+    size_t size {0};
+    for (const auto &message : messages)
+        size += message.size();
+    return size;
+}
 
 std::ostream &operator<<(std::ostream &os, const ENetAddress &e) {
     os << e.host << ':' << e.port;
@@ -75,7 +152,8 @@ std::ostream &operator<<(std::ostream &os, const ENetAddress &e) {
 }
 
 void send_packet(ENetPeer *peer, const std::vector<uint8_t> &data, int channel_id, ENetPacketFlag flags = ENET_PACKET_FLAG_RELIABLE) {
-    std::cout << "Sending packet: " << data << '\n';
+    if (logging(LogLevel::Debug))
+        std::cout << "Sending packet: " << data << '\n';
     ENetPacket *packet = enet_packet_create(data.data(), data.size(), flags);
     int val = enet_peer_send(peer, channel_id, packet);
     if (val != 0) {
@@ -84,88 +162,64 @@ void send_packet(ENetPeer *peer, const std::vector<uint8_t> &data, int channel_i
     }
 }
 
-void broadcast_packet(ENetHost *server, const std::vector<uint8_t> &data, int channel_id, ENetPacketFlag flags = ENET_PACKET_FLAG_RELIABLE) {
-    std::cout << "Broadcasting packet: " << data << '\n';
+// creates a packet that is kept alive after being sent, so it can be sent to any number of peers.
+// has to be freed with destroy_shared_packet()
+ENetPacket *create_shared_packet(const std::vector<uint8_t> &data, ENetPacketFlag flags = ENET_PACKET_FLAG_RELIABLE) {
     ENetPacket *packet = enet_packet_create(data.data(), data.size(), flags);
-    enet_host_broadcast(server, channel_id, packet);
+    // enet destroys packets once nothing references them, this reference is never dropped while the packet is shared
+    packet->referenceCount++;
+    return packet;
 }
 
-void parse_client_move(const ENetEvent &event) {
-    ClientData &cd {*static_cast<ClientData *>(event.peer->data)};
-    ClientMovementTypes movement_type {event.packet->data[1]};
-    ClientMovement movement {event.packet->data[2]};
-    switch (movement_type) {
-        case ClientMovementTypes::Start:
-            update_player_delta(movement, false, cd.player_movement);
-            break;
-        case ClientMovementTypes::Stop:
-            update_player_delta(movement, true, cd.player_movement);
-            break;
-        default:
-            std::cerr << "Client movement type not recognized: " << (int)movement_type << std::endl;
-    }
-    std::cout << "Client movement updated to: " << cd.player_movement.first << ", " << cd.player_movement.second << '\n';
+void destroy_shared_packet(ENetPacket *packet) {
+    packet->referenceCount--;
+    if (packet->referenceCount == 0)
+        enet_packet_destroy(packet);
 }
 
-void parse_client_shoot(const ENetEvent &event, std::vector<ProjectileDouble> &projectiles) {
-    assert(event.packet->dataLength == 13);
-    std::array<uint8_t, 12> projectile_data {
-        event.packet->data[1],
-        event.packet->data[2],
-        event.packet->data[3],
-        event.packet->data[4],
-        event.packet->data[5],
-        event.packet->data[6],
-        event.packet->data[7],
-        event.packet->data[8],
-        event.packet->data[9],
-        event.packet->data[10],
-        event.packet->data[11],
-        event.packet->data[12],
-    };
-    Projectile p {deserialize_projectile(projectile_data)};
-    ProjectileDouble pd {p, static_cast<ClientData *>(event.peer->data)->p.id};
-
-#ifdef DEBUG
-    std::cout << "Shooting projectile: " << pd.x << ", " << pd.y << ", " << p.dx << ", " << p.dy << '\n';
-#endif
-
-    projectiles.push_back(pd);
+void send_shared_packet(ENetPeer *peer, ENetPacket *packet, int channel_id) {
+    int val = enet_peer_send(peer, channel_id, packet);
+    if (val != 0)
+        std::cerr << "Failed to send shared packet: " << val << " to: " << peer->address << std::endl;
 }
 
-void set_client_attributes(const ENetEvent &event, std::map<int, ClientData> &players) {
+void set_client_attributes(const ENetEvent &event, GameState &state, MessageAssembler &outbound) {
     SetPlayerAttributesTypes attribute_type {event.packet->data[1]};
     ClientData &cd {*static_cast<ClientData *>(event.peer->data)};
-    auto id = cd.p.id;
+    auto id = cd.player_id;
     switch (attribute_type) {
         case SetPlayerAttributesTypes::UsernameChanged: {
             std::string username;
             int username_len = event.packet->data[2];
             for (int i {3}; i < username_len + 3; i++)
                 username.push_back(event.packet->data[i]);
-            players.at(id).p.username = username;
-            std::cout << "Set username of " << (int)cd.p.id << " to: " << username << '\n';
+            if (!state.set_username(id, username))
+                break; // the player has been killed
+            if (logging(LogLevel::Debug))
+                std::cout << "Set username of " << (int)id << " to: " << username << '\n';
             std::vector<uint8_t> data_to_send {
                 static_cast<uint8_t>(MessageToClientTypes::SetPlayerAttributes),
                 static_cast<uint8_t>(SetPlayerAttributesTypes::UsernameChanged),
-                static_cast<uint8_t>(id),
-                static_cast<uint8_t>(username_len),
             };
+            serialize_varint(data_to_send, id);
+            data_to_send.push_back(static_cast<uint8_t>(username_len));
             data_to_send.insert(data_to_send.end(), username.begin(), username.end());
-            broadcast_packet(event.peer->host, data_to_send, channel_user_updates);
+            outbound.broadcast(data_to_send, true);
             break;
         }
         case SetPlayerAttributesTypes::ColorChanged: {
             Color c {event.packet->data[2], event.packet->data[3], event.packet->data[4], event.packet->data[5]};
-            players.at(id).p.color = c;
-            std::cout << "Set color of " << (int)cd.p.id << " to: (" << (int)c.r << ", " << (int)c.g << ", " << (int)c.b << ", " << (int)c.a << ")\n";
+            if (!state.set_color(id, c))
+                break; // the player has been killed
+            if (logging(LogLevel::Debug))
+                std::cout << "Set color of " << (int)id << " to: (" << (int)c.r << ", " << (int)c.g << ", " << (int)c.b << ", " << (int)c.a << ")\n";
             std::vector<uint8_t> data_to_send {
                 static_cast<uint8_t>(MessageToClientTypes::SetPlayerAttributes),
                 static_cast<uint8_t>(SetPlayerAttributesTypes::ColorChanged),
-                static_cast<uint8_t>(id),
-                c.r, c.g, c.b, c.a
             };
-            broadcast_packet(event.peer->host, data_to_send, channel_user_updates);
+            serialize_varint(data_to_send, id);
+            data_to_send.insert(data_to_send.end(), {c.r, c.g, c.b, c.a});
+            outbound.broadcast(data_to_send, true);
             break;
         }
         default:
@@ -173,322 +227,520 @@ void set_client_attributes(const ENetEvent &event, std::map<int, ClientData> &pl
     }
 }
 
-void parse_event(const ENetEvent &event, std::vector<ProjectileDouble> &projectiles, std::map<int, ClientData> &players, bool game_started) {
+// inputs for the simulation are added to inputs and applied on the next tick.
+// returns whether the message was such an input
+bool parse_event(const ENetEvent &event, GameState &state, std::vector<GameInput> &inputs, const std::vector<ENetPacket *> &map_packets, MessageAssembler &outbound) {
     MessageToServerTypes event_type {event.packet->data[0]};
+    ClientData &cd {*static_cast<ClientData *>(event.peer->data)};
     if (event.channelID == channel_updates) {
         if (!(
             event_type == MessageToServerTypes::ClientMove ||
             event_type == MessageToServerTypes::Shoot
         )) {
             std::cerr << "Event type not recognized: " << (int)event_type << " " << __FILE_NAME__ << ": " << __LINE__ << std::endl;
-            return;
+            return false;
         }
-        std::cout << "Received event type: " << (int)event_type << std::endl;
-
-        if (event_type == MessageToServerTypes::ClientMove){
-            parse_client_move(event);
-        } else if (event_type == MessageToServerTypes::Shoot && game_started)
-            parse_client_shoot(event, projectiles);
+        if (logging(LogLevel::Debug))
+            std::cout << "Received event type: " << (int)event_type << std::endl;
     } else if (event.channelID == channel_user_updates) {
         if (!(event_type == MessageToServerTypes::SetClientAttributes ||
               event_type == MessageToServerTypes::ReadyUp ||
-              event_type == MessageToServerTypes::UnReady
+              event_type == MessageToServerTypes::UnReady ||
+              event_type == MessageToServerTypes::RequestMap
         )) {
             std::cerr << "Event type not recognized: " << (int)event_type << " " << __FILE_NAME__ << ": " << __LINE__ << std::endl;
-            return;
+            return false;
         }
         if (event_type == MessageToServerTypes::SetClientAttributes) {
-            set_client_attributes(event, players);
-        } else if (event_type == MessageToServerTypes::ReadyUp) {
-            std::cout << "Player " << players.at(static_cast<ClientData *>(event.peer->data)->p.id).p.id << " is ready\n";
-            players.at(static_cast<ClientData *>(event.peer->data)->p.id).ready = true;
-        } else if (event_type == MessageToServerTypes::UnReady) {
-            std::cout << "Player " << players.at(static_cast<ClientData *>(event.peer->data)->p.id).p.id << " is not ready\n";
-            players.at(static_cast<ClientData *>(event.peer->data)->p.id).ready = false;
+            set_client_attributes(event, state, outbound);
+            return false;
+        } else if (event_type == MessageToServerTypes::RequestMap) {
+            if (logging(LogLevel::Debug))
+                std::cout << "Sending " << map_packets.size() << " map chunks to " << event.peer->address << '\n';
+            for (auto packet : map_packets)
+                send_shared_packet(event.peer, packet, channel_events);
+            return false;
         }
+        if (logging(LogLevel::Info))
+            std::cout << "Player " << (int)cd.player_id << (event_type == MessageToServerTypes::ReadyUp ? " is ready\n" : " is not ready\n");
+    } else {
+        return false;
     }
+
+    GameInput input;
+    if (!parse_game_input(event.packet->data, event.packet->dataLength, cd.player_id, input))
+        return false;
+    inputs.push_back(input);
+    return true;
 }
 
-std::map<uint8_t, uint8_t> run_game_tick(std::map<int, ClientData> &players, const std::vector<Obstacle> &obstacles, std::vector<ProjectileDouble> &projectiles) {
-    for (auto &[id, data] : players) {
-        if (data.player_movement == std::make_pair<short, short>(0, 0))
-            continue;
-        auto actual_movement = std::make_pair(data.player_movement.first, data.player_movement.second);
-        if ((data.p.x <= min_x && actual_movement.first == -1) ||
-            (data.p.x >= max_x && actual_movement.first == 1)) {
-            actual_movement.first = 0;
-        }
-        if ((data.p.y <= min_y && actual_movement.second == -1) ||
-            (data.p.y >= max_y && actual_movement.second == 1)) {
-            actual_movement.second = 0;
+// binds a host to the address. The hosts of all the shards share the server's port with SO_REUSEPORT,
+// which has the kernel spread the connections over them by hashing each client's address
+ENetHost *create_host(const ENetAddress &address, bool reuse_port, const ServerConfig &config) {
+    ENetHost *host {enet_host_create(reuse_port ? nullptr : &address, config.max_players, num_channels, 0, 0)};
+    if (host == nullptr)
+        return nullptr;
+    if (reuse_port) {
+        if (enet_socket_set_option(host->socket, ENET_SOCKOPT_REUSEPORT, 1) < 0 || enet_socket_bind(host->socket, &address) < 0) {
+            enet_host_destroy(host);
+            return nullptr;
         }
-        if (actual_movement == std::make_pair<short, short>(0, 0))
-            continue;
-        Player test_px {data.p};
-        test_px.move(std::make_pair(data.player_movement.first, 0));
-        auto collision_x = detect_collision(test_px, obstacles);
-
-        Player test_py {data.p};
-        test_py.move(std::make_pair(0, data.player_movement.second));
-        auto collision_y = detect_collision(test_py, obstacles);
-
-#ifdef DEBUG
-        std::cout << "Collision x: " << collision_x << ", Collision y: " << collision_y << '\n';
-#endif
-
-        if (collision_x)
-            actual_movement.first = 0;
-        if (collision_y)
-            actual_movement.second = 0;
-        data.p.move(actual_movement);
-#ifdef DEBUG
-        if (actual_movement != std::make_pair<short, short>(0, 0))
-            std::cout << "Player moved to " << id << ": " << data.p.x << ", " << data.p.y << '\n';
-#endif
+        if (enet_socket_get_address(host->socket, &host->address) < 0)
+            host->address = address;
     }
-    std::map<uint8_t, uint8_t> dead_players;
-    std::vector<uint16_t> projectiles_to_remove;
-    projectiles_to_remove.reserve(projectiles.size());
-    uint16_t idx = 0;
-    for (auto &p : projectiles) {
-        p.move(4);
-        Player player_that_got_hit;
-        bool hit_player = std::any_of(
-            players.begin(), players.end(),
-            [p, &player_that_got_hit](const std::pair<uint8_t, ClientData> &data) {
-                if (point_in_rect(data.second.p.x, data.second.p.y, player_size * 2, player_size * 2, p.x, p.y) &&
-                    data.second.p.id != p.player_id)
-                {
-                    player_that_got_hit = data.second.p;
-                    return true;
-                }
-                return false;
-        });
-        double distance_travelled = std::sqrt(std::pow(p.x - p.start_x, 2) + std::pow(p.y - p.start_y, 2));
-        if (p.x > max_x || p.y > max_y + player_size || p.x < min_x || p.y < min_y || (hit_player) || distance_travelled >= max_obstacle_distance_travelled ||
-            std::any_of(obstacles.begin(), obstacles.end(), 
-                        [p](Obstacle ob) { return point_in_rect(ob.x, ob.y, ob.width * 2, ob.height * 2, p.x, p.y); })
-        ) {
-            projectiles_to_remove.push_back(idx);
-            if (hit_player) {
-                // someone got hit and died
-                dead_players[player_that_got_hit.id] = p.player_id;
-            }
-        }
-        idx++;
+    if (!enable_compression(host, config.codec)) {
+        std::cerr << "Couldn't set up compression" << std::endl;
+        enet_host_destroy(host);
+        return nullptr;
     }
-    for (auto idx : projectiles_to_remove)
-        projectiles.erase(projectiles.begin() + idx);
-    return dead_players;
+    return host;
 }
 
-int main(int argv, char **argc) {
-    if (enet_initialize() != 0) {
-        std::cerr << "Couldn't initialize enet" << std::endl;
-        return 1;
-    }
-    std::atexit(enet_deinitialize);
-    std::cout << std::boolalpha;
-
-    ENetAddress address;
-    address.host = ENET_HOST_ANY;
-    address.port = 8888;
-    if (argv > 1)
-        address.port = std::stoi(argc[1]);
-
-    ENetHost *server {enet_host_create(&address, max_players, num_channels, 0, 0)};
-    if (server == NULL) {
-        std::cerr << "Couldn't initialize ENetHost" << std::endl;
-        return 1;
-    }
-
-    std::map<int, ClientData> players;
-    std::vector<ProjectileDouble> projectiles;
-    int new_player_id {0};
-
-    bool running = true;
-    ENetEvent event;
-    std::cout << "hosting on port " << address.port << std::endl;
-    bool game_started = false;
-
-    // map3 kind of looks cool
-    // map5 has a big wall
-    const std::vector<Obstacle> obstacles {load_from_file("maps/map2.txt")};
-    std::cout << "Loaded " << obstacles.size() << " obstacles" << std::endl;
-    // whether the server should send a list of empty projectiles
-    bool sent_empty_projectiles = false;
-    bool player_won = false;
-
-#if defined(DEBUG)
-    for (const auto &o : obstacles) {
-        std::cout << "Read obstacle at: (" << o.x << ", " << o.y << ") (" << o.width << ", " << o.height << ")"
-            << "(" << (int)o.color.r << ", " << (int)o.color.g << ", " << (int)o.color.b << ", " << (int)o.color.a << ")" << std::endl;
-        auto data = serialize_obstacle(o);
-        std::cout << "Correct obstacle serialized: " << data << std::endl;
+// waits until a datagram arrives for one of the hosts, one of their emulated datagrams is due or timeout_ms have passed
+void wait_for_hosts(const std::vector<ENetHost *> &hosts, uint32_t timeout_ms) {
+    ENetSocketSet sockets;
+    ENET_SOCKETSET_EMPTY(sockets);
+    ENetSocket max_socket {0};
+    for (ENetHost *host : hosts) {
+        ENET_SOCKETSET_ADD(sockets, host->socket);
+        max_socket = std::max(max_socket, host->socket);
+        timeout_ms = network_emulation_wait_ms(host, timeout_ms);
     }
-#endif
+    enet_socketset_select(max_socket, &sockets, nullptr, timeout_ms);
+}
 
-    auto last_time = std::chrono::high_resolution_clock::now();
+// A match running on its own thread, with its own hosts, players and game.
+//
+// With more than one shard, every shard has a host on the server's port (the kernel picks which one a new
+// client lands on) and one on port + 1 + index. A client that lands on a shard whose game has already
+// started is sent to the port of a shard that is still in its lobby.
+struct Shard {
+    size_t index;
+    // the host on the shared port first, then the shard's own if there is more than one shard
+    std::vector<ENetHost *> hosts;
+    std::thread thread;
+};
 
-    while (running) {
-        int err = enet_host_service(server, &event, tick_rate_ms);
-        if (err < 0) {
-            std::cerr << "An error occurred in enet" << std::endl;
-        }
+void run_shard(const Shard &shard, ShardDirectory &directory, const ServerConfig &config, const CompiledMap &map) {
+    trace_thread_name(directory.size() > 1 ? "shard " + std::to_string(shard.index) : "server");
+    // messages about a single match say which one when there are several
+    std::string match {directory.size() > 1 ? "[match " + std::to_string(shard.index) + "] " : ""};
+
+    std::map<int, ClientData> clients;
+    IdAllocator player_ids {config.max_players};
+    // everything sent to players during a tick goes out together at the end of it, and then the arena is reset
+    TickArena tick_arena {tick_arena_size};
+    MessageAssembler outbound {&tick_arena};
+    // heap allocations and ticks since the stats were last printed
+    uint64_t tick_heap_allocations {0};
+    uint32_t ticks_counted {0};
+
+    // only used to send the map to clients
+    const std::vector<Obstacle> obstacles {map.obstacles()};
+
+    uint64_t seed {std::random_device {}()};
+    seed = (seed << 32) ^ static_cast<uint64_t>(std::chrono::system_clock::now().time_since_epoch().count());
+    seed_random(seed);
+
+    GameState state {map, config.rules};
+    // inputs received since the last tick
+    std::vector<GameInput> pending_inputs;
+    ReplayWriter replay;
+    // every match records to its own file
+    std::string replay_file_name {config.replay_file_name};
+    if (!replay_file_name.empty() && directory.size() > 1)
+        replay_file_name += "." + std::to_string(shard.index);
+    if (!replay_file_name.empty() && replay.open(replay_file_name, map.content_hash(), seed, config.rules, config.tick_rate))
+        std::cout << match << "Recording replay to " << replay_file_name << std::endl;
+
+    // the map is the same for every player, so it is only encoded once and the packets are shared by all of the match's peers
+    std::vector<ENetPacket *> map_packets;
+    for (const auto &chunk : serialize_obstacle_chunks(obstacles))
+        map_packets.push_back(create_shared_packet(chunk));
+    ENetPacket *map_info_packet {create_shared_packet(serialize_map_info({
+        map.content_hash(), static_cast<uint16_t>(obstacles.size()), static_cast<uint16_t>(map_packets.size())
+    }))};
+    SnapshotHistory snapshot_history;
+
+    // a snapshot at any quality is as old as its interval, stretched when fewer snapshots than ticks are sent
+    auto scaled_quality = [](SnapshotQuality quality) {
+        quality.interval_ticks *= live_settings.snapshot_interval.load(std::memory_order_relaxed);
+        return quality;
+    };
+    const double tick_ms {config.tick_ms()};
 
+    auto handle_event = [&](const ENetEvent &event) {
         switch (event.type) {
             case ENET_EVENT_TYPE_CONNECT: {
-                std::cout << "A new client connected from: " << event.peer->address.host << ':' << event.peer->address.port << std::endl;
-                if (game_started) {
+                TRACE_SCOPE("connect");
+                if (logging(LogLevel::Info))
+                    std::cout << match << "A new client connected from: " << event.peer->address.host << ':' << event.peer->address.port << std::endl;
+                if (!compression_compatible(event.data, config.codec)) {
+                    if (logging(LogLevel::Info))
+                        std::cout << match << "Client can't decompress " << compression_codec_name(config.codec) << " packets, disconnecting it" << std::endl;
+                    enet_peer_disconnect_now(event.peer, disconnect_unsupported_compression);
+                    break;
+                }
+                if (state.game_started()) {
+                    if (auto lobby = directory.pick_lobby(shard.index)) {
+                        if (logging(LogLevel::Info))
+                            std::cout << match << "Game has already started, sending new player to match " << *lobby << std::endl;
+                        enet_peer_disconnect(event.peer, disconnect_redirect | static_cast<uint16_t>(config.port + 1 + *lobby));
+                        break;
+                    }
+                    enet_peer_disconnect(event.peer, 0);
+                    if (logging(LogLevel::Info))
+                        std::cout << match << "Game has already started, disconnecting new player" << std::endl;
+                    break;
+                }
+                if (clients.size() >= live_settings.max_players.load(std::memory_order_relaxed)) {
+                    if (logging(LogLevel::Info))
+                        std::cout << match << "The match is full, disconnecting new player" << std::endl;
                     enet_peer_disconnect(event.peer, 0);
-                    std::cout << "Game has already started, disconnecting new player" << std::endl;
+                    break;
+                }
+                PlayerId new_player_id;
+                if (!player_ids.allocate(new_player_id)) {
+                    std::cerr << "No player ids left, disconnecting new player" << std::endl;
+                    enet_peer_disconnect_now(event.peer, 0);
+                    break;
                 }
-                players_connected++;
-                Player p {default_player};
-                p.username += std::to_string(new_player_id);
-                p.id = new_player_id;
-                p.color = random_color();
-                ClientData c {p, false, {0, 0}};
-                players[new_player_id] = c;
-                event.peer->data = &players.at(new_player_id);
+                Player p {state.add_player(new_player_id)};
+                replay.write({state.tick(), ReplayEventType::Connect, p.id, 0, {}});
+                clients.insert_or_assign(new_player_id, ClientData {p.id, event.peer, CongestionController {live_settings.peer_bytes_per_second.load(std::memory_order_relaxed), p.id, tick_ms}});
+                event.peer->data = &clients.at(new_player_id);
 
                 std::vector<uint8_t> broadcast_data = serialize_player(p);
                 broadcast_data.insert(broadcast_data.cbegin(), static_cast<uint8_t>(MessageToClientTypes::PlayerJoined));
-                broadcast_packet(server, broadcast_data, channel_events);
+                // the new player expects its own player to be the first thing it receives
+                send_packet(event.peer, broadcast_data, channel_events);
+                std::pmr::vector<ENetPeer *> new_peer {{event.peer}, &tick_arena};
+                outbound.broadcast(broadcast_data, true, new_peer);
+
+                if (logging(LogLevel::Debug))
+                    std::cout << "Streaming the world to player " << new_player_id << std::endl;
 
-                std::cout << "Sending previous game data to player " << new_player_id << std::endl;
+                // the obstacles are only sent if the player asks for them after getting the map info
+                send_shared_packet(event.peer, map_info_packet, channel_events);
 
+                TRACE_SCOPE("stream world");
                 std::vector<Player> other_players;
-                for (const auto &[id, data] : players) {
+                for (const auto &[id, data] : state.players()) {
                     if(id == new_player_id)
                         continue;
                     other_players.push_back(data.p);
                 }
-                std::vector<uint8_t> previous_game_data {serialize_previous_game_data(other_players, obstacles)};
-
-#ifdef DEBUG
-                // testing if serializing and deserializing previous game data works
-                auto [p2, o2] = deserialize_and_update_previous_game_data(previous_game_data);
-                if (p2.size() != other_players.size()) {
-                    std::cerr << "slkdjflskdf" << std::endl;
-                }
-                if (o2.size() != obstacles.size()) {
-                    std::cerr << "slkdjflskdf obstacles" << std::endl;
-                }
-                for (size_t i {0}; i < p2.size(); i++) {
-                    auto p1 {other_players[i]};
-                    auto p3 {p2.at(p1.id)};
-                    if (p1.id != p3.id || p1.username != p3.username || p1.x != p3.x || p1.y != p3.y || p1.color.r != p3.color.r || p1.color.g != p3.color.g || p1.color.b != p3.color.b || p1.color.a != p3.color.a) {
-                        std::cerr << "slkdjflskdf player is different\n"
-                                  << "player1: " << p1.username << "(" << (int)p1.x << ", " << (int)p1.y << ")" << "(" << (int)p1.color.r << ", " << (int)p1.color.g << ", " << (int)p1.color.b << ", " << (int)p1.color.a << ")\n"
-                                  << " player2: " << p3.username << "(" << (int)p3.x << ", " << (int)p3.y << ")" << "(" << (int)p3.color.r << ", " << (int)p3.color.g << ", " << (int)p3.color.b << ", " << (int)p3.color.a << ")" << std::endl;
-                    }
-                }
-                std::cout << "Checking obstacles" << std::endl;
-                for (size_t i {0}; i < o2.size(); i++) {
-                    std::cout << "Checking obstacle " << i << std::endl;
-                    auto o1 {obstacles[i]};
-                    auto o3 {o2[i]};
-                    if (o1.x != o3.x || o1.y != o3.y || o1.width != o3.width || o1.height != o3.height || o1.color.r != o3.color.r || o1.color.g != o3.color.g || o1.color.b != o3.color.b || o1.color.a != o3.color.a)
-                        std::cerr << "slkdjflskdf obstacle is different " << std::endl;
-                }
-#endif
-
-                previous_game_data.insert(previous_game_data.begin(), static_cast<uint8_t>(MessageToClientTypes::PreviousGameData));
-
-                send_packet(event.peer, previous_game_data, channel_events);
-
-                new_player_id++;
+                auto player_chunks {serialize_player_chunks(other_players)};
+                // chunks and the completion marker are reliable and on the same channel, so they arrive in order
+                for (const auto &chunk : player_chunks)
+                    send_packet(event.peer, chunk, channel_events);
+                send_packet(event.peer, serialize_world_complete(player_chunks.size(), other_players.size(), obstacles.size()), channel_events);
                 break;
             }
             case ENET_EVENT_TYPE_RECEIVE: {
+                TRACE_SCOPE("receive");
+#ifdef DEBUG
                 std::vector<short> data;
-                for (int i {0}; i < event.packet->dataLength; i++)
+                for (size_t i {0}; i < event.packet->dataLength; i++)
                     data.push_back(event.packet->data[i]);
-#ifdef DEBUG
                 std::cout << "A packet of length " << event.packet->dataLength
                         << " containing \"" << data << "\" "
                         << "was received from " << event.peer->address << " "
                         << "from channel " << static_cast<int>(event.channelID) << std::endl;
 #endif
-                parse_event(event, projectiles, players, game_started);
+                if (parse_event(event, state, pending_inputs, map_packets, outbound)) {
+                    ReplayEvent input {state.tick(), ReplayEventType::Input, static_cast<ClientData *>(event.peer->data)->player_id, event.channelID, {}};
+                    input.data.assign(event.packet->data, event.packet->data + event.packet->dataLength);
+                    replay.write(input);
+                }
                 break;
             }
             case ENET_EVENT_TYPE_DISCONNECT: {
-                std::cout << event.peer->address.host << ':' << event.peer->address.port << " disconnected." << std::endl;
-                players_connected--;
+                TRACE_SCOPE("disconnect");
+                if (logging(LogLevel::Info))
+                    std::cout << match << event.peer->address.host << ':' << event.peer->address.port << " disconnected." << std::endl;
+                outbound.forget(event.peer);
                 ClientData *c = static_cast<ClientData *>(event.peer->data);
-                std::vector<uint8_t> broadcast_data {static_cast<uint8_t>(MessageToClientTypes::PlayerLeft), c->p.id};
-                auto player = players.find(c->p.id);
-                if (player != players.end()) { // if the player is still alive in the game
-                    players.erase(player);
-                    broadcast_packet(server, broadcast_data, channel_events);
+                if (!c)
+                    break; // never got a player id
+                PlayerId id {c->player_id};
+                replay.write({state.tick(), ReplayEventType::Disconnect, id, 0, {}});
+                if (state.remove_player(id)) { // if the player is still alive in the game
+                    std::vector<uint8_t> broadcast_data {static_cast<uint8_t>(MessageToClientTypes::PlayerLeft)};
+                    serialize_varint(broadcast_data, id);
+                    outbound.broadcast(broadcast_data, true);
                 }
+                clients.erase(id);
+                snapshot_history.last_moved_tick.erase(id);
+                player_ids.release(id);
+                event.peer->data = nullptr;
                 break;
             }
             case ENET_EVENT_TYPE_NONE:
                 break;
         }
-        auto now = std::chrono::high_resolution_clock::now();
-        auto elapsed_time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_time).count();
-        if (!game_started) {
-            game_started = std::all_of(players.begin(), players.end(), [](const std::pair<int, ClientData> &data) { return data.second.ready; })
-                           && players_connected > 1;
-            if (game_started) {
-                std::cout << "The game has started!" << std::endl;
-                broadcast_packet(server, {static_cast<uint8_t>(MessageToClientTypes::GameStarted)}, channel_events);
+    };
+
+    auto last_time = std::chrono::high_resolution_clock::now();
+
+    while (running) {
+        {
+            double interval_ms {lobby_is_idle(state, pending_inputs) ? lobby_idle_tick_rate_ms : tick_ms};
+            auto elapsed_time_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - last_time).count();
+            if (clients.empty())
+                wait_for_hosts(shard.hosts, empty_wait_ms);
+            else
+                wait_for_hosts(shard.hosts, elapsed_time_ms >= interval_ms ? 0 : static_cast<uint32_t>(interval_ms - elapsed_time_ms));
+        }
+        for (ENetHost *host : shard.hosts) {
+            update_network_emulation(host);
+            ENetEvent event;
+            int err;
+            do {
+                {
+                    TRACE_SCOPE("enet_host_service");
+                    err = enet_host_service(host, &event, 0);
+                }
+                if (err > 0)
+                    handle_event(event);
+            } while (err > 0);
+            if (err < 0) {
+                std::cerr << "An error occurred in enet" << std::endl;
             }
         }
-        if (elapsed_time_ms >= tick_rate_ms || is_within(elapsed_time_ms, tick_rate_ms, 1)) {
+        directory.update(shard.index, !state.game_started(), state.players().size());
+
+        auto now = std::chrono::high_resolution_clock::now();
+        if (clients.empty()) {
+            // the first player to join starts the clock again
+            last_time = now;
+            continue;
+        }
+        // anything that arrived while the lobby was idle is simulated right away
+        double interval_ms {lobby_is_idle(state, pending_inputs) ? lobby_idle_tick_rate_ms : tick_ms};
+        auto elapsed_time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_time).count();
+        if (elapsed_time_ms >= interval_ms || is_within(elapsed_time_ms, interval_ms, 1)) {
+            TRACE_SCOPE("tick");
+            uint64_t allocations_before_tick {heap_allocations()};
             last_time = now;
-            auto dead_players = run_game_tick(players, obstacles, projectiles);
-            for (auto [killed, killer] : dead_players) {
-                players.erase(killed);
-                std::vector<uint8_t> data_to_send {
-                    static_cast<uint8_t>(MessageToClientTypes::PlayerKilled),
-                    killer,
-                    killed
-                };
-                broadcast_packet(server, data_to_send, channel_events);
+            auto game_events = state.step(pending_inputs);
+            pending_inputs.clear();
+            replay.end_tick(state.tick());
+            if (state.tick() % (compression_stats_interval_s * config.tick_rate) == 0) {
+                if (logging(LogLevel::Info)) {
+                    std::cout << match << "Compression: " << *compression_stats(shard.hosts[0]) << std::endl;
+                    std::cout << match << "Heap allocations: " << tick_heap_allocations << " in the last " << ticks_counted << " ticks, tick arena "
+                              << tick_arena.capacity() << " bytes (" << tick_arena.heap_allocations() << " allocation(s) didn't fit so far)" << std::endl;
+                    if (shard.index == 0)
+                        std::cout << "Packet pools: " << packet_pool_stats() << std::endl;
+                    for (ENetHost *host : shard.hosts) {
+                        if (const NetworkEmulationStats *emulation = network_emulation_stats(host))
+                            std::cout << match << "Network emulation on port " << host->address.port << ": " << *emulation << std::endl;
+                    }
+                }
+                tick_heap_allocations = 0;
+                ticks_counted = 0;
+            }
+            for (const auto &game_event : game_events) {
+                switch (game_event.type) {
+                    case GameEventType::GameStarted:
+                        if (logging(LogLevel::Info))
+                            std::cout << match << "The game has started!" << std::endl;
+                        outbound.broadcast(std::vector<uint8_t> {static_cast<uint8_t>(MessageToClientTypes::GameStarted)}, true);
+                        break;
+                    case GameEventType::PlayerKilled: {
+                        std::vector<uint8_t> data_to_send {static_cast<uint8_t>(MessageToClientTypes::PlayerKilled)};
+                        serialize_varint(data_to_send, game_event.other_player_id);
+                        serialize_varint(data_to_send, game_event.player_id);
+                        outbound.broadcast(data_to_send, true);
+                        break;
+                    }
+                    case GameEventType::PlayerWon: {
+                        if (logging(LogLevel::Info))
+                            std::cout << match << "The game has ended!" << std::endl;
+                        std::vector<uint8_t> data_to_send {static_cast<uint8_t>(MessageToClientTypes::PlayerWon)};
+                        serialize_varint(data_to_send, game_event.player_id);
+                        outbound.broadcast(data_to_send, true);
+                        break;
+                    }
+                }
             }
 
-            std::vector<Player> players_to_update;
-            players_to_update.reserve(players.size());
-            for (const auto &[id, player_data]: players) {
-                if (player_data.player_movement == std::make_pair<short, short>(0, 0))
+            for (const auto &[id, player_data] : state.players()) {
+                if (player_data.player_movement != std::make_pair<short, short>(0, 0))
+                    snapshot_history.last_moved_tick[id] = state.tick();
+            }
+            if (!state.projectiles().empty())
+                snapshot_history.last_projectile_tick = state.tick();
+
+            TRACE_SCOPE("snapshots");
+            // peers at the best quality share one snapshot, the others get their own (or none this tick)
+            auto full_snapshot {build_snapshot(state, snapshot_history, scaled_quality(snapshot_qualities[0]), nullptr, &tick_arena)};
+            size_t full_snapshot_size {snapshot_size(full_snapshot)};
+            std::pmr::vector<ENetPeer *> degraded_peers {&tick_arena};
+            for (auto &[id, client] : clients) {
+                size_t old_level {client.congestion.quality_level()};
+                client.congestion.set_bytes_per_second(live_settings.peer_bytes_per_second.load(std::memory_order_relaxed));
+                client.congestion.update(client.peer, state.tick());
+                if (client.congestion.quality_level() != old_level && logging(LogLevel::Info))
+                    std::cout << match << "Snapshot quality of player " << id << " changed from " << old_level << " to "
+                              << client.congestion.quality_level() << " (rtt " << client.peer->roundTripTime << " ms, loss "
+                              << client.congestion.reliable_loss() * 100 << "%, throttle "
+                              << static_cast<double>(client.peer->packetThrottle) / ENET_PEER_PACKET_THROTTLE_SCALE << ")" << std::endl;
+                bool send_snapshot {client.congestion.should_send_snapshot(state.tick(), live_settings.snapshot_interval.load(std::memory_order_relaxed))};
+                if (send_snapshot && client.congestion.quality_level() == 0) {
+                    client.congestion.snapshot_sent(full_snapshot_size);
                     continue;
-                players_to_update.push_back(player_data.p);
+                }
+                degraded_peers.push_back(client.peer);
+                if (!send_snapshot)
+                    continue;
+                auto player = state.players().find(id);
+                const Player *viewer {player != state.players().end() ? &player->second.p : nullptr};
+                auto snapshot {build_snapshot(state, snapshot_history, scaled_quality(client.congestion.quality()), viewer, &tick_arena)};
+                client.congestion.snapshot_sent(snapshot_size(snapshot));
+                for (const auto &message : snapshot)
+                    outbound.send(client.peer, message, false);
             }
+            for (const auto &message : full_snapshot)
+                outbound.broadcast(message, false, degraded_peers);
+            outbound.flush(shard.hosts);
+            // nothing in the arena is used after this
+            full_snapshot.clear();
+            degraded_peers.clear();
+            tick_arena.reset();
+            tick_heap_allocations += heap_allocations() - allocations_before_tick;
+            ticks_counted++;
+        }
+    }
 
-            if (!players_to_update.empty()) {
-                std::vector<uint8_t> data_to_send {serialize_game_player_positions(players_to_update)};
-                data_to_send.insert(data_to_send.cbegin(), static_cast<uint8_t>(MessageToClientTypes::UpdatePlayerPositions));
-                broadcast_packet(server, data_to_send, channel_updates, ENET_PACKET_FLAG_UNSEQUENCED);
-            }
+    for (auto packet : map_packets)
+        destroy_shared_packet(packet);
+    destroy_shared_packet(map_info_packet);
+}
 
-            if (!projectiles.empty() || !sent_empty_projectiles) {
-                std::vector<uint8_t> projectile_data;
-                projectile_data.reserve(2 + projectiles.size() * sizeof(Projectile));
-                projectile_data.push_back(static_cast<uint8_t>(MessageToClientTypes::UpdateProjectiles));
-                projectile_data.push_back(static_cast<uint8_t>(projectiles.size()));
-                for (auto &pd: projectiles) {
-                    Projectile p {static_cast<uint16_t>(pd.x), static_cast<uint16_t>(pd.y), static_cast<int32_t>(pd.dx), static_cast<int32_t>(pd.dy)};
-                    auto p_data = serialize_projectile(p);
-                    projectile_data.insert(projectile_data.end(), p_data.cbegin(), p_data.cend());
-                }
-                broadcast_packet(server, projectile_data, channel_updates, ENET_PACKET_FLAG_UNSEQUENCED);
-                if (projectiles.empty())
-                    sent_empty_projectiles = true;
-                else
-                    sent_empty_projectiles = false;
+int main(int argv, char **argc) {
+    if (initialize_enet_with_pools(pooled_players) != 0) {
+        std::cerr << "Couldn't initialize enet" << std::endl;
+        return 1;
+    }
+    std::atexit(enet_deinitialize);
+    std::cout << std::boolalpha;
+
+    // spans are recorded if a file to write them to is given, it is written on SIGUSR1
+    trace_thread_name("main");
+    std::string trace_file_name;
+    if (const char *trace_file = std::getenv("LASTAND_TRACE")) {
+        trace_file_name = trace_file;
+        set_tracing(true);
+#ifdef SIGUSR1
+        std::signal(SIGUSR1, [](int) { trace_dump_requested = 1; });
+        std::cout << "Tracing, send SIGUSR1 to write the trace to " << trace_file_name << std::endl;
+#else
+        std::cout << "Tracing to " << trace_file_name << std::endl;
+#endif
+    }
+
+    // every accepted input is recorded to the replay file if given (- for none), replay it with Lastand-Replay.
+    // Matches run at the same time, each on its own thread
+    ServerConfig config;
+    if (!parse_command_line(argv, argc, config)) {
+        std::cerr << "usage: " << argc[0] << " [port] [replay file or -] [codec] [matches] [--config=file] [--option=value...]" << std::endl;
+        return 1;
+    }
+    live_settings.load(config);
+    size_t shards {config.matches};
+    // a lossy, laggy network is emulated if its conditions are given, see parse_network_conditions()
+    if (const char *netem = std::getenv("LASTAND_NETEM")) {
+        NetworkConditions conditions;
+        if (!parse_network_conditions(netem, conditions)) {
+            std::cerr << "Couldn't parse LASTAND_NETEM=" << netem << ", expected e.g. delay=80,jitter=20,loss=2,out.duplicate=1" << std::endl;
+            return 1;
+        }
+        config.network_conditions = conditions;
+        std::cout << "Emulating network conditions: " << conditions << std::endl;
+    }
+
+    // map3 kind of looks cool
+    // map5 has a big wall
+    const CompiledMap map {load_map(config.map)};
+    std::cout << "Loaded " << map.obstacles().size() << " obstacles, map hash " << std::hex << map.content_hash() << std::dec << std::endl;
+
+#if defined(DEBUG)
+    for (const auto &o : map.obstacles()) {
+        std::cout << "Read obstacle at: (" << o.x << ", " << o.y << ") (" << o.width << ", " << o.height << ")"
+            << "(" << (int)o.color.r << ", " << (int)o.color.g << ", " << (int)o.color.b << ", " << (int)o.color.a << ")" << std::endl;
+        auto data = serialize_obstacle(o);
+        std::cout << "Correct obstacle serialized: " << data << std::endl;
+    }
+#endif
+
+    std::vector<Shard> shard_list(shards);
+    for (size_t i {0}; i < shards; i++) {
+        shard_list[i].index = i;
+        ENetAddress address {ENET_HOST_ANY, config.port};
+        ENetHost *host {create_host(address, shards > 1, config)};
+        if (host == nullptr) {
+            std::cerr << "Couldn't initialize ENetHost" << std::endl;
+            return 1;
+        }
+        shard_list[i].hosts.push_back(host);
+        if (shards > 1) {
+            ENetAddress own_address {ENET_HOST_ANY, static_cast<uint16_t>(config.port + 1 + i)};
+            ENetHost *own_host {create_host(own_address, false, config)};
+            if (own_host == nullptr) {
+                std::cerr << "Couldn't initialize the ENetHost on port " << own_address.port << std::endl;
+                return 1;
             }
-            if (game_started && players.size() == 1 && !player_won) {
-                std::cout << "The game has ended!" << std::endl;
-                broadcast_packet(server, {static_cast<uint8_t>(MessageToClientTypes::PlayerWon), players.begin()->second.p.id}, channel_events);
-                player_won = true;
+            shard_list[i].hosts.push_back(own_host);
+        }
+    }
+    if (config.network_conditions) {
+        // every host makes its own choices, the same ones every run
+        NetworkConditions conditions {*config.network_conditions};
+        for (auto &shard : shard_list) {
+            for (ENetHost *host : shard.hosts) {
+                enable_network_emulation(host, conditions);
+                conditions.seed++;
             }
         }
     }
+    std::cout << "Config: " << config << std::endl;
+    std::cout << "Compressing packets with " << compression_codec_name(config.codec) << std::endl;
+    std::cout << "hosting on port " << config.port;
+    if (shards > 1)
+        std::cout << ", " << shards << " matches on ports " << config.port + 1 << " to " << config.port + shards;
+    std::cout << std::endl;
+
+    AdminSocket admin {config, live_settings};
+    if (config.admin_port != 0) {
+        if (!admin.open(config.admin_port)) {
+            std::cerr << "Couldn't open the admin socket on port " << config.admin_port << std::endl;
+            return 1;
+        }
+        std::cout << "Taking admin commands on localhost:" << config.admin_port << std::endl;
+    }
+
+    ShardDirectory directory {shards};
+    for (auto &shard : shard_list)
+        shard.thread = std::thread {run_shard, std::cref(shard), std::ref(directory), std::cref(config), std::cref(map)};
+
+    while (running) {
+        if (config.admin_port != 0)
+            admin.poll(100);
+        else
+            std::this_thread::sleep_for(std::chrono::milliseconds {100});
+        if (trace_dump_requested) {
+            trace_dump_requested = 0;
+            dump_trace(trace_file_name);
+        }
+    }
 
-    enet_host_destroy(server);
+    for (auto &shard : shard_list) {
+        shard.thread.join();
+        for (ENetHost *host : shard.hosts) {
+            disable_network_emulation(host);
+            enet_host_destroy(host);
+        }
+    }
 }
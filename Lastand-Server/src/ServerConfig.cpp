@@ -0,0 +1,231 @@
+#include "ServerConfig.h"
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <utility>
+#include <vector>
+#include "IdAllocator.h"
+
+const char *log_level_name(LogLevel level) {
+    switch (level) {
+        case LogLevel::Error:
+            return "error";
+        case LogLevel::Info:
+            return "info";
+        case LogLevel::Debug:
+            return "debug";
+    }
+    return "unknown";
+}
+
+// the whole value has to be a number from min to max
+static bool parse_number(const std::string &value, uint64_t min, uint64_t max, uint64_t &number) {
+    if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos || value.size() > 19)
+        return false;
+    number = std::stoull(value);
+    return number >= min && number <= max;
+}
+
+static std::string trim(const std::string &s) {
+    size_t start {s.find_first_not_of(" \t\r")};
+    if (start == std::string::npos)
+        return "";
+    return s.substr(start, s.find_last_not_of(" \t\r") - start + 1);
+}
+
+std::ostream &operator<<(std::ostream &os, const ServerConfig &config) {
+    os << "port " << config.port << ", replay " << (config.replay_file_name.empty() ? "-" : config.replay_file_name)
+       << ", codec " << compression_codec_name(config.codec) << ", matches " << config.matches << ", map " << config.map
+       << ", tick_rate " << config.tick_rate << ", snapshot_interval " << config.snapshot_interval
+       << ", max_players " << config.max_players << ", peer_bytes_per_second " << config.peer_bytes_per_second
+       << ", projectile_range " << config.rules.projectile_range
+       << ", max_projectiles " << config.rules.max_projectiles_per_player << ", log_level " << log_level_name(config.log_level)
+       << ", admin_port " << config.admin_port;
+    return os;
+}
+
+bool set_config_option(ServerConfig &config, const std::string &key, const std::string &value, std::string &error) {
+    uint64_t number {0};
+    auto number_option = [&](uint64_t min, uint64_t max) {
+        if (parse_number(value, min, max, number))
+            return true;
+        error = key + " has to be a number from " + std::to_string(min) + " to " + std::to_string(max) + ", not \"" + value + "\"";
+        return false;
+    };
+
+    if (key == "port") {
+        if (!number_option(1, 65535))
+            return false;
+        config.port = static_cast<uint16_t>(number);
+    } else if (key == "replay") {
+        config.replay_file_name = value == "-" ? "" : value;
+    } else if (key == "codec") {
+        if (!parse_compression_codec(value, config.codec)) {
+            error = "unknown compression codec " + value + ", expected none, range or lz";
+            return false;
+        }
+    } else if (key == "matches") {
+        if (!number_option(1, 1024))
+            return false;
+        config.matches = number;
+    } else if (key == "map") {
+        if (value.empty()) {
+            error = "map can't be empty";
+            return false;
+        }
+        config.map = value;
+    } else if (key == "tick_rate") {
+        if (!number_option(1, 1000))
+            return false;
+        config.tick_rate = static_cast<uint32_t>(number);
+    } else if (key == "snapshot_interval") {
+        if (!number_option(1, 120))
+            return false;
+        config.snapshot_interval = static_cast<uint32_t>(number);
+    } else if (key == "max_players") {
+        if (!number_option(1, max_player_slots))
+            return false;
+        config.max_players = number;
+    } else if (key == "peer_bytes_per_second") {
+        // less than a snapshot a second would leave players without any
+        if (!number_option(1024, 1 << 30))
+            return false;
+        config.peer_bytes_per_second = static_cast<uint32_t>(number);
+    } else if (key == "projectile_range") {
+        if (!number_option(1, std::numeric_limits<uint16_t>::max()))
+            return false;
+        config.rules.projectile_range = static_cast<uint16_t>(number);
+    } else if (key == "max_projectiles") {
+        if (!number_option(0, std::numeric_limits<uint16_t>::max()))
+            return false;
+        config.rules.max_projectiles_per_player = static_cast<uint16_t>(number);
+    } else if (key == "log_level") {
+        if (value == "error") {
+            config.log_level = LogLevel::Error;
+        } else if (value == "info") {
+            config.log_level = LogLevel::Info;
+        } else if (value == "debug") {
+            config.log_level = LogLevel::Debug;
+        } else {
+            error = "unknown log level " + value + ", expected error, info or debug";
+            return false;
+        }
+    } else if (key == "admin_port") {
+        if (!number_option(0, 65535))
+            return false;
+        config.admin_port = static_cast<uint16_t>(number);
+    } else {
+        error = "unknown option " + key;
+        return false;
+    }
+    return true;
+}
+
+bool load_config_file(const std::string &file_name, ServerConfig &config) {
+    std::ifstream file {file_name};
+    if (!file.is_open()) {
+        std::cerr << "Could not open config file: " << file_name << std::endl;
+        return false;
+    }
+    std::string line;
+    for (int line_number {1}; std::getline(file, line); line_number++) {
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty())
+            continue;
+        size_t equals {line.find('=')};
+        std::string error;
+        if (equals == std::string::npos) {
+            error = "expected key = value";
+        } else if (set_config_option(config, trim(line.substr(0, equals)), trim(line.substr(equals + 1)), error)) {
+            continue;
+        }
+        std::cerr << file_name << ':' << line_number << ": " << error << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool parse_command_line(int argc, char **argv, ServerConfig &config) {
+    const char *positional[] {"port", "replay", "codec", "matches"};
+    std::vector<std::pair<std::string, std::string>> options;
+    size_t positional_count {0};
+    bool named_options {false};
+    for (int i {1}; i < argc; i++) {
+        std::string arg {argv[i]};
+        if (arg.rfind("--", 0) != 0) {
+            if (named_options || positional_count == std::size(positional)) {
+                std::cerr << "Unexpected argument " << arg << ", options go after the port, replay file, codec and number of matches" << std::endl;
+                return false;
+            }
+            options.emplace_back(positional[positional_count++], arg);
+            continue;
+        }
+        named_options = true;
+        size_t equals {arg.find('=')};
+        if (equals != std::string::npos) {
+            options.emplace_back(arg.substr(2, equals - 2), arg.substr(equals + 1));
+        } else if (i + 1 < argc) {
+            options.emplace_back(arg.substr(2), argv[++i]);
+        } else {
+            std::cerr << "Missing the value of " << arg << std::endl;
+            return false;
+        }
+    }
+
+    // the file is read first so anything else on the command line overrides it
+    for (const auto &[key, value] : options) {
+        if (key == "config" && !load_config_file(value, config))
+            return false;
+    }
+    for (const auto &[key, value] : options) {
+        std::string error;
+        if (key != "config" && !set_config_option(config, key, value, error)) {
+            std::cerr << error << std::endl;
+            return false;
+        }
+    }
+    if (config.port + config.matches > 65535) {
+        std::cerr << "The ports of the " << config.matches << " matches have to fit after " << config.port << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void LiveSettings::load(const ServerConfig &config) {
+    snapshot_interval.store(config.snapshot_interval, std::memory_order_relaxed);
+    max_players.store(config.max_players, std::memory_order_relaxed);
+    peer_bytes_per_second.store(config.peer_bytes_per_second, std::memory_order_relaxed);
+    log_level.store(config.log_level, std::memory_order_relaxed);
+}
+
+bool LiveSettings::set(const ServerConfig &config, const std::string &key, const std::string &value, std::string &error) {
+    if (key != "snapshot_interval" && key != "max_players" && key != "peer_bytes_per_second" && key != "log_level") {
+        error = key + " can't be changed while the server runs, only snapshot_interval, max_players, peer_bytes_per_second and log_level can";
+        return false;
+    }
+    ServerConfig changed {config};
+    if (!set_config_option(changed, key, value, error))
+        return false;
+    if (changed.max_players > config.max_players) {
+        error = "max_players can't go over the " + std::to_string(config.max_players) + " the server started with";
+        return false;
+    }
+    if (key == "snapshot_interval")
+        snapshot_interval.store(changed.snapshot_interval, std::memory_order_relaxed);
+    else if (key == "max_players")
+        max_players.store(changed.max_players, std::memory_order_relaxed);
+    else if (key == "peer_bytes_per_second")
+        peer_bytes_per_second.store(changed.peer_bytes_per_second, std::memory_order_relaxed);
+    else
+        log_level.store(changed.log_level, std::memory_order_relaxed);
+    return true;
+}
+
+std::ostream &operator<<(std::ostream &os, const LiveSettings &live) {
+    os << "snapshot_interval " << live.snapshot_interval.load(std::memory_order_relaxed)
+       << ", max_players " << live.max_players.load(std::memory_order_relaxed)
+       << ", peer_bytes_per_second " << live.peer_bytes_per_second.load(std::memory_order_relaxed)
+       << ", log_level " << log_level_name(live.log_level.load(std::memory_order_relaxed));
+    return os;
+}
@@ -0,0 +1,87 @@
+#pragma once
+#ifndef SERVER_CONFIG_H
+#define SERVER_CONFIG_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include "Compression.h"
+#include "GameState.h"
+#include "NetworkEmulator.h"
+
+enum class LogLevel: uint8_t {
+    Error = 0,
+    Info = 1,
+    // every packet sent and received
+    Debug = 2
+};
+
+const char *log_level_name(LogLevel level);
+
+// How the server is set up, from the defaults, then the config file, then the command line. Every option
+// has the same name in the file (key = value) and on the command line (--key=value):
+//
+//   port                   the port clients connect to
+//   replay                 file every match is recorded to, nothing is recorded if empty
+//   codec                  none, range or lz
+//   matches                matches run at once, each on its own thread
+//   map                    path of the map without the extension
+//   tick_rate              simulation steps per second
+//   snapshot_interval      ticks between snapshots at the best quality, *
+//   max_players            players in a match, * (up to the number the server started with)
+//   peer_bytes_per_second  most bytes of snapshots a player is sent per second, *
+//   projectile_range       how far a projectile flies
+//   max_projectiles        projectiles a player can have in the air, 0 for no limit
+//   log_level              error, info or debug, *
+//   admin_port             port on localhost that takes admin commands, 0 for none
+//
+// The ones marked * can also be changed while the server runs through the admin port, see AdminSocket.
+struct ServerConfig {
+    uint16_t port {8888};
+    std::string replay_file_name;
+    CompressionCodec codec {CompressionCodec::LZ};
+    size_t matches {1};
+    std::string map {"maps/map2"};
+    uint32_t tick_rate {120};
+    uint32_t snapshot_interval {1};
+    size_t max_players {1000};
+    uint32_t peer_bytes_per_second {64 * 1024};
+    GameRules rules;
+    LogLevel log_level {LogLevel::Info};
+    uint16_t admin_port {0};
+    // emulated on every host if set, from LASTAND_NETEM
+    std::optional<NetworkConditions> network_conditions;
+
+    double tick_ms() const { return 1000.0 / tick_rate; }
+};
+
+std::ostream &operator<<(std::ostream &os, const ServerConfig &config);
+
+// sets one option, returns false and says why in error if the key or the value isn't valid
+bool set_config_option(ServerConfig &config, const std::string &key, const std::string &value, std::string &error);
+// reads key = value lines, # starts a comment
+bool load_config_file(const std::string &file_name, ServerConfig &config);
+// usage: Lastand-Server [port] [replay file or -] [codec] [matches] [--config=file] [--option=value...]
+// The positional arguments come first, the config file is read before any other option
+bool parse_command_line(int argc, char **argv, ServerConfig &config);
+
+// The options that can change while the server runs, read by every match at every tick
+struct LiveSettings {
+    std::atomic<uint32_t> snapshot_interval {1};
+    std::atomic<size_t> max_players {1000};
+    std::atomic<uint32_t> peer_bytes_per_second {64 * 1024};
+    std::atomic<LogLevel> log_level {LogLevel::Info};
+
+    // starts from the values in the config
+    void load(const ServerConfig &config);
+    // sets one of the options that can change, checked like set_config_option(). max_players can't go over
+    // the config's, the server only has room for that many
+    bool set(const ServerConfig &config, const std::string &key, const std::string &value, std::string &error);
+};
+
+std::ostream &operator<<(std::ostream &os, const LiveSettings &live);
+
+#endif // SERVER_CONFIG_H
@@ -0,0 +1,24 @@
+#include "ShardDirectory.h"
+
+ShardDirectory::ShardDirectory(size_t shards): shards {shards}, entries {std::make_unique<Entry[]>(shards)} {}
+
+void ShardDirectory::update(size_t shard, bool in_lobby, size_t players) {
+    entries[shard].in_lobby.store(in_lobby, std::memory_order_relaxed);
+    entries[shard].players.store(static_cast<uint32_t>(players), std::memory_order_relaxed);
+}
+
+std::optional<size_t> ShardDirectory::pick_lobby(size_t except) const {
+    // filling the fullest lobby first gets a match going sooner than spreading players over all of them
+    std::optional<size_t> best;
+    uint32_t best_players {0};
+    for (size_t i {0}; i < shards; i++) {
+        if (i == except || !entries[i].in_lobby.load(std::memory_order_relaxed))
+            continue;
+        uint32_t players {entries[i].players.load(std::memory_order_relaxed)};
+        if (!best || players > best_players) {
+            best = i;
+            best_players = players;
+        }
+    }
+    return best;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#ifndef SHARD_DIRECTORY_H
+#define SHARD_DIRECTORY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+// What the shards (matches running on their own threads) know about each other, so a shard can
+// hand a player whose connection landed on it off to a match that can still take them.
+//
+// Each shard writes only its own entry, any shard can read all of them.
+class ShardDirectory {
+public:
+    explicit ShardDirectory(size_t shards);
+
+    // call whenever a shard's players or lobby state may have changed
+    void update(size_t shard, bool in_lobby, size_t players);
+    // the shard, other than except, whose lobby has the most players, nullopt if no lobby is open
+    std::optional<size_t> pick_lobby(size_t except) const;
+
+    size_t size() const { return shards; }
+
+private:
+    struct Entry {
+        std::atomic<bool> in_lobby {true};
+        std::atomic<uint32_t> players {0};
+    };
+    size_t shards;
+    std::unique_ptr<Entry[]> entries;
+};
+
+#endif // SHARD_DIRECTORY_H
@@ -111,6 +111,9 @@ enet_host_create (const ENetAddress * address, size_t peerCount, size_t channelL
 
     host -> intercept = NULL;
 
+    host -> datagramBatch = NULL;
+    host -> sendIntercept = NULL;
+
     enet_list_clear (& host -> dispatchQueue);
 
     for (currentPeer = host -> peers;
@@ -157,6 +160,9 @@ enet_host_destroy (ENetHost * host)
     if (host -> compressor.context != NULL && host -> compressor.destroy)
       (* host -> compressor.destroy) (host -> compressor.context);
 
+    if (host -> datagramBatch != NULL)
+      enet_free (host -> datagramBatch);
+
     enet_free (host -> peers);
     enet_free (host);
 }
@@ -63,7 +63,8 @@ typedef enum _ENetSocketOption
    ENET_SOCKOPT_SNDTIMEO  = 7,
    ENET_SOCKOPT_ERROR     = 8,
    ENET_SOCKOPT_NODELAY   = 9,
-   ENET_SOCKOPT_TTL       = 10
+   ENET_SOCKOPT_TTL       = 10,
+   ENET_SOCKOPT_REUSEPORT = 11
 } ENetSocketOption;
 
 typedef enum _ENetSocketShutdown
@@ -93,6 +94,21 @@ typedef struct _ENetAddress
    enet_uint16 port;
 } ENetAddress;
 
+/**
+ * A datagram sent or received with enet_socket_send_batch() or enet_socket_receive_batch().
+ *
+ * The buffer holds the whole datagram. Before receiving, dataLength is the room in the buffer,
+ * afterwards it is the length of the datagram received, or 0 if it didn't fit and was dropped.
+ */
+typedef struct _ENetDatagram
+{
+   ENetAddress address;
+   ENetBuffer  buffer;
+} ENetDatagram;
+
+/** most datagrams sent or received in one enet_socket_send_batch() or enet_socket_receive_batch() call */
+#define ENET_DATAGRAM_BATCH_MAXIMUM 64
+
 /**
  * Packet flag bit constants.
  *
@@ -345,6 +361,9 @@ typedef enet_uint32 (ENET_CALLBACK * ENetChecksumCallback) (const ENetBuffer * b
 
 /** Callback for intercepting received raw UDP packets. Should return 1 to intercept, 0 to ignore, or -1 to propagate an error. */
 typedef int (ENET_CALLBACK * ENetInterceptCallback) (struct _ENetHost * host, struct _ENetEvent * event);
+
+/** Callback for intercepting raw UDP packets about to be sent to address, held in buffers[0:bufferCount-1]. Should return the length of the packet if it took it, 0 to let the host send it, or -1 to propagate an error. */
+typedef int (ENET_CALLBACK * ENetSendInterceptCallback) (struct _ENetHost * host, const ENetAddress * address, const ENetBuffer * buffers, size_t bufferCount);
  
 /** An ENet host for communicating with peers.
   *
@@ -400,6 +419,8 @@ typedef struct _ENetHost
    size_t               duplicatePeers;              /**< optional number of allowed peers from duplicate IPs, defaults to ENET_PROTOCOL_MAXIMUM_PEER_ID */
    size_t               maximumPacketSize;           /**< the maximum allowable packet size that may be sent or received on a peer */
    size_t               maximumWaitingData;          /**< the maximum aggregate amount of buffer space a peer may use waiting for packets to be delivered */
+   void *               datagramBatch;               /**< internal use only, datagrams waiting to be sent or handled when built with ENET_BATCHED_IO */
+   ENetSendInterceptCallback sendIntercept;          /**< callback the user can set to intercept raw UDP packets before they are sent */
 } ENetHost;
 
 /**
@@ -504,6 +525,8 @@ ENET_API ENetSocket enet_socket_accept (ENetSocket, ENetAddress *);
 ENET_API int        enet_socket_connect (ENetSocket, const ENetAddress *);
 ENET_API int        enet_socket_send (ENetSocket, const ENetAddress *, const ENetBuffer *, size_t);
 ENET_API int        enet_socket_receive (ENetSocket, ENetAddress *, ENetBuffer *, size_t);
+ENET_API int        enet_socket_send_batch (ENetSocket, const ENetDatagram *, size_t);
+ENET_API int        enet_socket_receive_batch (ENetSocket, ENetDatagram *, size_t);
 ENET_API int        enet_socket_wait (ENetSocket, enet_uint32 *, enet_uint32);
 ENET_API int        enet_socket_set_option (ENetSocket, ENetSocketOption, int);
 ENET_API int        enet_socket_get_option (ENetSocket, ENetSocketOption, int *);
@@ -570,6 +593,7 @@ ENET_API ENetPeer * enet_host_connect (ENetHost *, const ENetAddress *, size_t,
 ENET_API int        enet_host_check_events (ENetHost *, ENetEvent *);
 ENET_API int        enet_host_service (ENetHost *, ENetEvent *, enet_uint32);
 ENET_API void       enet_host_flush (ENetHost *);
+ENET_API int        enet_host_receive (ENetHost *, const ENetAddress *, const void *, size_t);
 ENET_API void       enet_host_broadcast (ENetHost *, enet_uint8, ENetPacket *);
 ENET_API void       enet_host_compress (ENetHost *, const ENetCompressor *);
 ENET_API int        enet_host_compress_with_range_coder (ENetHost * host);
@@ -1228,16 +1228,174 @@ commandError:
     return 0;
 }
  
+#ifdef ENET_BATCHED_IO
+/* Datagrams are taken off the socket with one recvmmsg() and handled one at a time from here, and
+   the datagrams sent to every peer are copied here and sent with one sendmmsg(), instead of a
+   system call per datagram. */
+typedef struct _ENetDatagramBatch
+{
+   size_t       sendCount;
+   size_t       receiveCount;
+   size_t       receiveNext;
+   ENetDatagram send [ENET_DATAGRAM_BATCH_MAXIMUM];
+   ENetDatagram receive [ENET_DATAGRAM_BATCH_MAXIMUM];
+   enet_uint8   sendData [ENET_DATAGRAM_BATCH_MAXIMUM][ENET_PROTOCOL_MAXIMUM_MTU];
+   enet_uint8   receiveData [ENET_DATAGRAM_BATCH_MAXIMUM][ENET_PROTOCOL_MAXIMUM_MTU];
+} ENetDatagramBatch;
+
+static ENetDatagramBatch *
+enet_protocol_datagram_batch (ENetHost * host)
+{
+    if (host -> datagramBatch == NULL)
+    {
+        ENetDatagramBatch * batch = (ENetDatagramBatch *) enet_malloc (sizeof (ENetDatagramBatch));
+        if (batch == NULL)
+          return NULL;
+
+        batch -> sendCount = 0;
+        batch -> receiveCount = 0;
+        batch -> receiveNext = 0;
+
+        host -> datagramBatch = batch;
+    }
+
+    return (ENetDatagramBatch *) host -> datagramBatch;
+}
+
+static int
+enet_protocol_datagrams_waiting (ENetHost * host)
+{
+    ENetDatagramBatch * batch = (ENetDatagramBatch *) host -> datagramBatch;
+
+    return batch != NULL && batch -> receiveNext < batch -> receiveCount;
+}
+
+static int
+enet_protocol_receive_datagram (ENetHost * host, ENetBuffer * buffer)
+{
+    ENetDatagramBatch * batch = enet_protocol_datagram_batch (host);
+    ENetDatagram * datagram;
+
+    if (batch == NULL)
+    {
+        buffer -> data = host -> packetData [0];
+        buffer -> dataLength = sizeof (host -> packetData [0]);
+
+        return enet_socket_receive (host -> socket, & host -> receivedAddress, buffer, 1);
+    }
+
+    if (batch -> receiveNext >= batch -> receiveCount)
+    {
+        size_t slot;
+        int received;
+
+        for (slot = 0; slot < ENET_DATAGRAM_BATCH_MAXIMUM; ++ slot)
+        {
+            batch -> receive [slot].buffer.data = batch -> receiveData [slot];
+            batch -> receive [slot].buffer.dataLength = sizeof (batch -> receiveData [slot]);
+        }
+
+        received = enet_socket_receive_batch (host -> socket, batch -> receive, ENET_DATAGRAM_BATCH_MAXIMUM);
+        if (received <= 0)
+          return received;
+
+        batch -> receiveCount = received;
+        batch -> receiveNext = 0;
+    }
+
+    datagram = & batch -> receive [batch -> receiveNext ++];
+    if (datagram -> buffer.dataLength == 0)
+      return -2;
+
+    host -> receivedAddress = datagram -> address;
+    * buffer = datagram -> buffer;
+
+    return (int) datagram -> buffer.dataLength;
+}
+
+static int
+enet_protocol_flush_datagrams (ENetHost * host)
+{
+    ENetDatagramBatch * batch = (ENetDatagramBatch *) host -> datagramBatch;
+    size_t datagram;
+    int sent;
+
+    if (batch == NULL || batch -> sendCount == 0)
+      return 0;
+
+    sent = enet_socket_send_batch (host -> socket, batch -> send, batch -> sendCount);
+
+    /* like a single send that would block, the datagrams that didn't fit in the socket's buffer are dropped */
+    for (datagram = sent < 0 ? 0 : (size_t) sent; datagram < batch -> sendCount; ++ datagram)
+    {
+        host -> totalSentData -= batch -> send [datagram].buffer.dataLength;
+        host -> totalSentPackets --;
+    }
+
+    batch -> sendCount = 0;
+
+    return sent < 0 ? -1 : 0;
+}
+
+static int
+enet_protocol_queue_datagram (ENetHost * host, const ENetAddress * address, const ENetBuffer * buffers, size_t bufferCount)
+{
+    ENetDatagramBatch * batch = enet_protocol_datagram_batch (host);
+    ENetDatagram * datagram;
+    enet_uint8 * data;
+    size_t buffer, length = 0;
+
+    for (buffer = 0; buffer < bufferCount; ++ buffer)
+      length += buffers [buffer].dataLength;
+
+    if (batch == NULL || length > ENET_PROTOCOL_MAXIMUM_MTU)
+    {
+        if (enet_protocol_flush_datagrams (host) < 0)
+          return -1;
+
+        return enet_socket_send (host -> socket, address, buffers, bufferCount);
+    }
+
+    if (batch -> sendCount >= ENET_DATAGRAM_BATCH_MAXIMUM &&
+        enet_protocol_flush_datagrams (host) < 0)
+      return -1;
+
+    datagram = & batch -> send [batch -> sendCount];
+    data = batch -> sendData [batch -> sendCount];
+    ++ batch -> sendCount;
+
+    datagram -> address = * address;
+    datagram -> buffer.data = data;
+    datagram -> buffer.dataLength = length;
+
+    for (buffer = 0; buffer < bufferCount; ++ buffer)
+    {
+        memcpy (data, buffers [buffer].data, buffers [buffer].dataLength);
+        data += buffers [buffer].dataLength;
+    }
+
+    return (int) length;
+}
+#endif
+
 static int
 enet_protocol_receive_incoming_commands (ENetHost * host, ENetEvent * event)
 {
     int packets;
 
+#ifdef ENET_BATCHED_IO
+    /* datagrams already taken off the socket have to be handled before the host waits on it again */
+    for (packets = 0; packets < 256 || enet_protocol_datagrams_waiting (host); ++ packets)
+#else
     for (packets = 0; packets < 256; ++ packets)
+#endif
     {
        int receivedLength;
        ENetBuffer buffer;
 
+#ifdef ENET_BATCHED_IO
+       receivedLength = enet_protocol_receive_datagram (host, & buffer);
+#else
        buffer.data = host -> packetData [0];
        buffer.dataLength = sizeof (host -> packetData [0]);
 
@@ -1245,6 +1403,7 @@ enet_protocol_receive_incoming_commands (ENetHost * host, ENetEvent * event)
                                              & host -> receivedAddress,
                                              & buffer,
                                              1);
+#endif
 
        if (receivedLength == -2)
          continue;
@@ -1255,7 +1414,7 @@ enet_protocol_receive_incoming_commands (ENetHost * host, ENetEvent * event)
        if (receivedLength == 0)
          return 0;
 
-       host -> receivedData = host -> packetData [0];
+       host -> receivedData = (enet_uint8 *) buffer.data;
        host -> receivedDataLength = receivedLength;
       
        host -> totalReceivedData += receivedLength;
@@ -1597,7 +1756,7 @@ enet_protocol_check_outgoing_commands (ENetHost * host, ENetPeer * peer, ENetLis
 }
 
 static int
-enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int checkForTimeouts)
+enet_protocol_send_outgoing_datagrams (ENetHost * host, ENetEvent * event, int checkForTimeouts)
 {
     enet_uint8 headerData [sizeof (ENetProtocolHeader) + sizeof (enet_uint32)];
     ENetProtocolHeader * header = (ENetProtocolHeader *) headerData;
@@ -1724,7 +1883,17 @@ enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int ch
 
         currentPeer -> lastSendTime = host -> serviceTime;
 
-        sentLength = enet_socket_send (host -> socket, & currentPeer -> address, host -> buffers, host -> bufferCount);
+        sentLength = 0;
+
+        if (host -> sendIntercept != NULL)
+          sentLength = host -> sendIntercept (host, & currentPeer -> address, host -> buffers, host -> bufferCount);
+
+        if (sentLength == 0)
+#ifdef ENET_BATCHED_IO
+          sentLength = enet_protocol_queue_datagram (host, & currentPeer -> address, host -> buffers, host -> bufferCount);
+#else
+          sentLength = enet_socket_send (host -> socket, & currentPeer -> address, host -> buffers, host -> bufferCount);
+#endif
 
         enet_protocol_remove_sent_unreliable_commands (currentPeer, & sentUnreliableCommands);
 
@@ -1742,6 +1911,19 @@ enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int ch
     return 0;
 }
 
+static int
+enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int checkForTimeouts)
+{
+    int result = enet_protocol_send_outgoing_datagrams (host, event, checkForTimeouts);
+
+#ifdef ENET_BATCHED_IO
+    if (enet_protocol_flush_datagrams (host) < 0)
+      return -1;
+#endif
+
+    return result;
+}
+
 /** Sends any queued packets on the host specified to its designated peers.
 
     @param host   host to flush
@@ -1756,6 +1938,35 @@ enet_host_flush (ENetHost * host)
     enet_protocol_send_outgoing_commands (host, NULL, 0);
 }
 
+/** Handles a raw UDP packet as if it had just been received from a peer, without passing it to the intercept callback.
+
+    @param host       host that receives the packet
+    @param address    address the packet came from
+    @param data       the packet
+    @param dataLength length of the packet
+    @retval 0 if the packet was handled or ignored
+    @retval < 0 on failure
+    @remarks lets an intercept callback that took a packet hand it back later. Any events it causes are
+    dispatched by the next call to enet_host_service() or enet_host_check_events().
+    @ingroup host
+*/
+int
+enet_host_receive (ENetHost * host, const ENetAddress * address, const void * data, size_t dataLength)
+{
+    if (dataLength > sizeof (host -> packetData [0]))
+      return -1;
+
+    host -> serviceTime = enet_time_get ();
+
+    memcpy (host -> packetData [0], data, dataLength);
+
+    host -> receivedAddress = * address;
+    host -> receivedData = host -> packetData [0];
+    host -> receivedDataLength = dataLength;
+
+    return enet_protocol_handle_incoming_commands (host, NULL) < 0 ? -1 : 0;
+}
+
 /** Checks for any queued events on the host and dispatches one if available.
 
     @param host    host to check for events
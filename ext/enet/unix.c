@@ -4,6 +4,10 @@
 */
 #ifndef _WIN32
 
+#if (defined (HAS_SENDMMSG) || defined (HAS_RECVMMSG)) && ! defined (_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
@@ -318,6 +322,12 @@ enet_socket_set_option (ENetSocket socket, ENetSocketOption option, int value)
             result = setsockopt (socket, SOL_SOCKET, SO_REUSEADDR, (char *) & value, sizeof (int));
             break;
 
+        case ENET_SOCKOPT_REUSEPORT:
+#ifdef SO_REUSEPORT
+            result = setsockopt (socket, SOL_SOCKET, SO_REUSEPORT, (char *) & value, sizeof (int));
+#endif
+            break;
+
         case ENET_SOCKOPT_RCVBUF:
             result = setsockopt (socket, SOL_SOCKET, SO_RCVBUF, (char *) & value, sizeof (int));
             break;
@@ -521,6 +531,149 @@ enet_socket_receive (ENetSocket socket,
     return recvLength;
 }
 
+/** Sends the datagrams, with a single sendmmsg() where it is available.
+    @returns the number of datagrams sent, which is less than datagramCount if the socket's buffer filled up, or < 0 on failure
+*/
+int
+enet_socket_send_batch (ENetSocket socket,
+                        const ENetDatagram * datagrams,
+                        size_t datagramCount)
+{
+#ifdef HAS_SENDMMSG
+    struct mmsghdr msgHdrs [ENET_DATAGRAM_BATCH_MAXIMUM];
+    struct sockaddr_in sins [ENET_DATAGRAM_BATCH_MAXIMUM];
+    size_t datagram, sent = 0;
+
+    if (datagramCount > ENET_DATAGRAM_BATCH_MAXIMUM)
+      datagramCount = ENET_DATAGRAM_BATCH_MAXIMUM;
+
+    memset (msgHdrs, 0, datagramCount * sizeof (struct mmsghdr));
+    memset (sins, 0, datagramCount * sizeof (struct sockaddr_in));
+
+    for (datagram = 0; datagram < datagramCount; ++ datagram)
+    {
+        sins [datagram].sin_family = AF_INET;
+        sins [datagram].sin_port = ENET_HOST_TO_NET_16 (datagrams [datagram].address.port);
+        sins [datagram].sin_addr.s_addr = datagrams [datagram].address.host;
+
+        msgHdrs [datagram].msg_hdr.msg_name = & sins [datagram];
+        msgHdrs [datagram].msg_hdr.msg_namelen = sizeof (struct sockaddr_in);
+        msgHdrs [datagram].msg_hdr.msg_iov = (struct iovec *) & datagrams [datagram].buffer;
+        msgHdrs [datagram].msg_hdr.msg_iovlen = 1;
+    }
+
+    /* sendmmsg stops at the first datagram that fails, the ones before it were sent */
+    while (sent < datagramCount)
+    {
+        int result = sendmmsg (socket, & msgHdrs [sent], datagramCount - sent, MSG_NOSIGNAL);
+
+        if (result == -1)
+        {
+           if (errno == EWOULDBLOCK || sent > 0)
+             break;
+
+           return -1;
+        }
+
+        sent += result;
+    }
+
+    return (int) sent;
+#else
+    size_t datagram;
+
+    for (datagram = 0; datagram < datagramCount; ++ datagram)
+    {
+        int sentLength = enet_socket_send (socket, & datagrams [datagram].address, & datagrams [datagram].buffer, 1);
+
+        if (sentLength < 0)
+          return datagram > 0 ? (int) datagram : -1;
+
+        if (sentLength == 0)
+          break;
+    }
+
+    return (int) datagram;
+#endif
+}
+
+/** Receives as many waiting datagrams as fit, with a single recvmmsg() where it is available.
+    @returns the number of datagrams received, 0 if none were waiting, or < 0 on failure
+*/
+int
+enet_socket_receive_batch (ENetSocket socket,
+                           ENetDatagram * datagrams,
+                           size_t datagramCount)
+{
+#ifdef HAS_RECVMMSG
+    struct mmsghdr msgHdrs [ENET_DATAGRAM_BATCH_MAXIMUM];
+    struct sockaddr_in sins [ENET_DATAGRAM_BATCH_MAXIMUM];
+    size_t datagram;
+    int received;
+
+    if (datagramCount > ENET_DATAGRAM_BATCH_MAXIMUM)
+      datagramCount = ENET_DATAGRAM_BATCH_MAXIMUM;
+
+    memset (msgHdrs, 0, datagramCount * sizeof (struct mmsghdr));
+
+    for (datagram = 0; datagram < datagramCount; ++ datagram)
+    {
+        msgHdrs [datagram].msg_hdr.msg_name = & sins [datagram];
+        msgHdrs [datagram].msg_hdr.msg_namelen = sizeof (struct sockaddr_in);
+        msgHdrs [datagram].msg_hdr.msg_iov = (struct iovec *) & datagrams [datagram].buffer;
+        msgHdrs [datagram].msg_hdr.msg_iovlen = 1;
+    }
+
+    received = recvmmsg (socket, msgHdrs, datagramCount, MSG_DONTWAIT, NULL);
+
+    if (received == -1)
+    {
+       if (errno == EWOULDBLOCK)
+         return 0;
+
+       return -1;
+    }
+
+    for (datagram = 0; datagram < (size_t) received; ++ datagram)
+    {
+        ENetDatagram * current = & datagrams [datagram];
+
+        if (msgHdrs [datagram].msg_hdr.msg_flags & MSG_TRUNC)
+          current -> buffer.dataLength = 0;
+        else
+          current -> buffer.dataLength = msgHdrs [datagram].msg_len;
+
+        current -> address.host = (enet_uint32) sins [datagram].sin_addr.s_addr;
+        current -> address.port = ENET_NET_TO_HOST_16 (sins [datagram].sin_port);
+    }
+
+    return received;
+#else
+    size_t datagram;
+
+    for (datagram = 0; datagram < datagramCount; ++ datagram)
+    {
+        int recvLength = enet_socket_receive (socket, & datagrams [datagram].address, & datagrams [datagram].buffer, 1);
+
+        if (recvLength == -2)
+        {
+           datagrams [datagram].buffer.dataLength = 0;
+           continue;
+        }
+
+        if (recvLength < 0)
+          return datagram > 0 ? (int) datagram : -1;
+
+        if (recvLength == 0)
+          break;
+
+        datagrams [datagram].buffer.dataLength = recvLength;
+    }
+
+    return (int) datagram;
+#endif
+}
+
 int
 enet_socketset_select (ENetSocket maxSocket, ENetSocketSet * readSet, ENetSocketSet * writeSet, enet_uint32 timeout)
 {
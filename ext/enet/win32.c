@@ -401,6 +401,62 @@ enet_socket_receive (ENetSocket socket,
     return (int) recvLength;
 }
 
+/** Sends the datagrams one at a time, Windows has no sendmmsg().
+    @returns the number of datagrams sent, which is less than datagramCount if the socket's buffer filled up, or < 0 on failure
+*/
+int
+enet_socket_send_batch (ENetSocket socket,
+                        const ENetDatagram * datagrams,
+                        size_t datagramCount)
+{
+    size_t datagram;
+
+    for (datagram = 0; datagram < datagramCount; ++ datagram)
+    {
+        int sentLength = enet_socket_send (socket, & datagrams [datagram].address, & datagrams [datagram].buffer, 1);
+
+        if (sentLength < 0)
+          return datagram > 0 ? (int) datagram : -1;
+
+        if (sentLength == 0)
+          break;
+    }
+
+    return (int) datagram;
+}
+
+/** Receives the waiting datagrams one at a time, Windows has no recvmmsg().
+    @returns the number of datagrams received, 0 if none were waiting, or < 0 on failure
+*/
+int
+enet_socket_receive_batch (ENetSocket socket,
+                           ENetDatagram * datagrams,
+                           size_t datagramCount)
+{
+    size_t datagram;
+
+    for (datagram = 0; datagram < datagramCount; ++ datagram)
+    {
+        int recvLength = enet_socket_receive (socket, & datagrams [datagram].address, & datagrams [datagram].buffer, 1);
+
+        if (recvLength == -2)
+        {
+           datagrams [datagram].buffer.dataLength = 0;
+           continue;
+        }
+
+        if (recvLength < 0)
+          return datagram > 0 ? (int) datagram : -1;
+
+        if (recvLength == 0)
+          break;
+
+        datagrams [datagram].buffer.dataLength = recvLength;
+    }
+
+    return (int) datagram;
+}
+
 int
 enet_socketset_select (ENetSocket maxSocket, ENetSocketSet * readSet, ENetSocketSet * writeSet, enet_uint32 timeout)
 {